@@ -58,9 +58,25 @@
 #define ALIGNMENT 8  
 
 /* 
- * Maximum heap size in bytes 
+ * Maximum heap size in bytes, the address space memlib reserves for it
  */
-#define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#include <stdint.h>
+#if UINTPTR_MAX > 0xffffffff
+#define MAX_HEAP ((size_t)1 << 32)  /* 4 GB of address space */
+#else
+#define MAX_HEAP (256*(1<<20))      /* 256 MB of address space */
+#endif
+
+/*
+ * Number of arenas the heap address space is split into, each with a
+ * brk of its own in ARENA_SPAN bytes. Only THREADS builds use several.
+ */
+#ifdef THREADS
+#define MAX_ARENAS 8
+#else
+#define MAX_ARENAS 1
+#endif
+#define ARENA_SPAN (MAX_HEAP / MAX_ARENAS)
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
@@ -15,6 +15,15 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#ifdef THREADS
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
@@ -29,6 +38,14 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define MT_REPS       10 /* times each thread replays the trace with -T */
+#define MT_RUNS        3 /* multithreaded runs, the fastest one is kept */
+#define PIPE_SLOTS  1024 /* blocks in flight between a producer and its consumer */
+#define MT_PATTERN(id, n) ((char)((id) * 37 + (n))) /* fills block n of thread id */
+#define BATCH_BLOCKS 4096 /* blocks allocated, then freed, by each round of -B */
+#define BATCH_ROUNDS   20 /* rounds timed by -B */
+#define POOL_OBJECTS 4096 /* objects allocated, then freed, by each round of -O */
+#define POOL_ROUNDS    20 /* rounds timed by -O */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
@@ -46,9 +63,11 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    enum {ALLOC, FREE, REALLOC, CALLOC, MEMALIGN} type; /* type of request */
     int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
+    int size;                         /* byte size of alloc/realloc request,
+					 or of the block to free */
+    int align;                        /* alignment of a memalign request */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -72,6 +91,27 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* Holds the params of one thread of the multithreaded runs */
+typedef struct {
+    trace_t *trace;
+    int id;          /* number of the thread, from 0 */
+    int check;       /* if set, fills and checks the blocks */
+    char **blocks;   /* this thread's ptrs returned by malloc/realloc */
+    int *sizes;      /* ... and the payload size of each */
+} thread_t;
+
+/* Carries the blocks a producer thread allocates to the consumer thread
+   that frees them, in a single-producer single-consumer ring */
+typedef struct {
+    trace_t *trace;
+    int id;              /* number of the pair, from 0 */
+    int check;           /* if set, fills and checks the blocks */
+    char *slots[PIPE_SLOTS];
+    int sizes[PIPE_SLOTS]; /* payload size of the block in each slot */
+    unsigned long head;  /* blocks put in the ring by the producer */
+    unsigned long tail;  /* blocks taken out by the consumer */
+} pipe_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
@@ -81,6 +121,12 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    mm_stats_t mm;   /* allocator counters for one run of the trace */
+    double misses;   /* cache misses for one run of the trace (-1 if unknown) */
+    size_t peak_heap;  /* largest heap size during the util run */
+    size_t final_heap; /* heap size at the end of the util run */
+    size_t resident;   /* heap bytes in physical pages at the end of the util run */
+    size_t committed;  /* heap bytes committed at the end of the util run */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
@@ -90,6 +136,7 @@ typedef struct {
  *******************/
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
+static int sized_free = 0; /* if set, replays free blocks with mm_free_sized (-S) */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
@@ -124,9 +171,34 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static double count_misses(void (*f)(void *), void *argp);
+#ifdef THREADS
+static void mt_verify(char *p, int size, char pattern, char *fn);
+static void *replay_thread(void *ptr);
+static double eval_mm_threads(trace_t *trace, int nthreads, int check);
+static void printthreads(char **tracefiles, int n, int max_threads);
+static void printarenas(char **tracefiles, int n, int max_threads, int max_arenas);
+static void *produce_thread(void *ptr);
+static void *consume_thread(void *ptr);
+static double eval_mm_pipes(trace_t *trace, int npipes, int check);
+static void printpipes(char **tracefiles, int n, int max_pipes);
+#endif
+static int eval_batch_valid(size_t size, int n, char **blocks, range_t **ranges);
+static double eval_mm_batch(size_t size, int n, int batched, char **blocks);
+static void printbatch(int max_batch);
+
+static double eval_mm_regions(trace_t *trace, int group, int check);
+static void printregions(char **tracefiles, int n, int group);
+
+static int eval_pool_valid(size_t size, char **blocks, range_t **ranges);
+static double eval_mm_pool(size_t size, int pooled, char **blocks);
+static void printpool(void);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printsearch(int n, stats_t *stats);
+static void printrealloc(int n, stats_t *stats);
+static void printheap(int n, stats_t *stats);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -150,6 +222,12 @@ int main(int argc, char **argv)
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int max_threads = 0; /* If set, replay the traces in 1 to max_threads threads (-T) */
+    int max_arenas = 0;  /* If set, repeat that with 1 to max_arenas arenas (-A) */
+    int max_pipes = 0;   /* If set, run 1 to max_pipes producer/consumer pairs (-P) */
+    int max_batch = 0;   /* If set, compare batches of max_batch blocks to single calls (-B) */
+    int region_group = 0;/* If set, replay the traces with a region per region_group blocks (-R) */
+    int run_pool = 0;    /* If set, compare pools to single calls (-O) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,7 +236,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:T:A:P:B:R:hvVgalHSO")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -184,6 +262,57 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'T': /* Measure throughput in 1 to max_threads threads */
+#ifndef THREADS
+            printf("ERROR: -T needs an mm.c built with THREADS=1\n");
+            exit(1);
+#endif
+            if ((max_threads = atoi(optarg)) < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'A': /* Measure throughput with 1 to max_arenas arenas */
+#ifndef THREADS
+            printf("ERROR: -A needs an mm.c built with THREADS=1\n");
+            exit(1);
+#endif
+            if ((max_arenas = atoi(optarg)) < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'P': /* Measure throughput of 1 to max_pipes producer/consumer pairs */
+#ifndef THREADS
+            printf("ERROR: -P needs an mm.c built with THREADS=1\n");
+            exit(1);
+#endif
+            if ((max_pipes = atoi(optarg)) < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'B': /* Compare batched allocations and frees to single calls */
+            if ((max_batch = atoi(optarg)) < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'R': /* Compare regions of region_group blocks to single calls */
+            if ((region_group = atoi(optarg)) < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'O': /* Compare pools to single calls */
+            run_pool = 1;
+            break;
+        case 'S': /* Free blocks with mm_free_sized */
+            sized_free = 1;
+            break;
+        case 'H': /* Back the simulated heap with transparent huge pages */
+            mem_use_hugepages(1);
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -298,11 +427,19 @@ int main(int argc, char **argv)
 	    if (verbose > 1)
 		printf("efficiency, ");
 	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+	    mm_stats[i].peak_heap = mem_peak_heapsize();
+	    mm_stats[i].final_heap = mem_heapsize() + mem_mapped();
+	    mm_stats[i].resident = mem_resident();
+	    mm_stats[i].committed = mem_committed();
 	    speed_params.trace = trace;
 	    speed_params.ranges = ranges;
 	    if (verbose > 1)
 		printf("and performance.\n");
 	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+
+	    /* One more run to collect the allocator and cache counters */
+	    mm_stats[i].misses = count_misses(eval_mm_speed, &speed_params);
+	    mm_get_stats(&mm_stats[i].mm);
 	}
 	free_trace(trace);
     }
@@ -311,9 +448,33 @@ int main(int argc, char **argv)
     if (verbose) {
 	printf("\nResults for mm malloc:\n");
 	printresults(num_tracefiles, mm_stats);
+	printf("\nFree block search cost for mm malloc:\n");
+	printsearch(num_tracefiles, mm_stats);
+	printf("\nRealloc copies for mm malloc:\n");
+	printrealloc(num_tracefiles, mm_stats);
+	printf("\nHeap size for mm malloc (%lu bytes reserved):\n",
+	       (unsigned long)mem_reserved());
+	printheap(num_tracefiles, mm_stats);
 	printf("\n");
     }
 
+#ifdef THREADS
+    /* Optionally measure how the throughput scales with the threads */
+    if (max_threads > 0 && errors == 0)
+	printthreads(tracefiles, num_tracefiles, max_threads);
+    if (max_arenas > 0 && errors == 0)
+	printarenas(tracefiles, num_tracefiles,
+		    max_threads > 0 ? max_threads : max_arenas, max_arenas);
+    if (max_pipes > 0 && errors == 0)
+	printpipes(tracefiles, num_tracefiles, max_pipes);
+#endif
+    if (max_batch > 0 && errors == 0)
+	printbatch(max_batch);
+    if (region_group > 0 && errors == 0)
+	printregions(tracefiles, num_tracefiles, region_group);
+    if (run_pool && errors == 0)
+	printpool();
+
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
      */
@@ -395,9 +556,11 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap, or within
+       one region mapped apart from it */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+	!mem_in_region(lo, hi)) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
@@ -477,7 +640,7 @@ static trace_t *read_trace(char *tracedir, char *filename)
     trace_t *trace;
     char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
+    unsigned index, size, align;
     unsigned max_index = 0;
     unsigned op_index;
 
@@ -527,6 +690,21 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	    trace->ops[op_index].size = size;
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
+	case 'c':
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    trace->ops[op_index].type = CALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'm':
+	    fscanf(tracefile, "%u %u %u", &index, &size, &align);
+	    trace->ops[op_index].type = MEMALIGN;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    trace->ops[op_index].align = align;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
 	case 'r':
 	    fscanf(tracefile, "%u %u", &index, &size);
 	    trace->ops[op_index].type = REALLOC;
@@ -538,12 +716,16 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	    fscanf(tracefile, "%ud", &index);
 	    trace->ops[op_index].type = FREE;
 	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = trace->block_sizes[index];
 	    break;
 	default:
 	    printf("Bogus type character (%c) in tracefile %s\n", 
 		   type[0], path);
 	    exit(1);
 	}
+	/* Remember the size of each block for the request that frees it */
+	if (trace->ops[op_index].type != FREE)
+	    trace->block_sizes[index] = size;
 	op_index++;
 	
     }
@@ -602,9 +784,17 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
-
-	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+        case CALLOC: /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
+
+	    /* Call the student's malloc, calloc or memalign */
+	    if (trace->ops[i].type == ALLOC)
+		p = mm_malloc(size);
+	    else if (trace->ops[i].type == CALLOC)
+		p = mm_calloc(1, size);
+	    else
+		p = mm_memalign(trace->ops[i].align, size);
+	    if (p == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
@@ -616,6 +806,29 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	     */ 
 	    if (add_range(ranges, p, size, tracenum, i) == 0)
 		return 0;
+
+	    /* The block must hold at least what was asked for */
+	    if (mm_usable_size(p) < size) {
+		malloc_error(tracenum, i, "mm_usable_size is below the request");
+		return 0;
+	    }
+
+	    /* A block from mm_memalign must have the alignment asked for */
+	    if (trace->ops[i].type == MEMALIGN &&
+		(size_t)p % trace->ops[i].align != 0) {
+		malloc_error(tracenum, i, "mm_memalign did not align the block");
+		return 0;
+	    }
+
+	    /* A block from mm_calloc must read as zero */
+	    if (trace->ops[i].type == CALLOC) {
+		for (j = 0; j < size; j++) {
+		    if (p[j] != 0) {
+			malloc_error(tracenum, i, "mm_calloc did not zero the block");
+			return 0;
+		    }
+		}
+	    }
 	    
 	    /* ADDED: cgw
 	     * fill range with low byte of index.  This will be used later
@@ -644,6 +857,10 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Check new block for correctness and add it to range list */
 	    if (add_range(ranges, newp, size, tracenum, i) == 0)
 		return 0;
+	    if (mm_usable_size(newp) < size) {
+		malloc_error(tracenum, i, "mm_usable_size is below the request");
+		return 0;
+	    }
 	    
 	    /* ADDED: cgw
 	     * Make sure that the new block contains the data from the old 
@@ -671,7 +888,10 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Remove region from list and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    if (sized_free)
+		mm_free_sized(p, size);
+	    else
+		mm_free(p);
 	    break;
 
 	default:
@@ -689,10 +909,10 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
+ *   largest size the heap, plus the regions mapped apart from it,
+ *   reached while running the student's malloc package on the trace.
+ *   mem_sbrk() lets the package give memory back, so the final brk
+ *   may be lower than that high water mark.
  *   
  */
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
@@ -714,10 +934,18 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
+        case CALLOC: /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if (trace->ops[i].type == ALLOC)
+		p = mm_malloc(size);
+	    else if (trace->ops[i].type == CALLOC)
+		p = mm_calloc(1, size);
+	    else
+		p = mm_memalign(trace->ops[i].align, size);
+	    if (p == NULL)
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -760,7 +988,10 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    if (sized_free)
+		mm_free_sized(p, size);
+	    else
+		mm_free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -774,7 +1005,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
         }
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size / (double)mem_peak_heapsize());
 }
 
 
@@ -805,6 +1036,22 @@ static void eval_mm_speed(void *ptr)
             trace->blocks[index] = p;
             break;
 
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_calloc(1, size)) == NULL)
+		app_error("mm_calloc error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+		app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
 	case REALLOC: /* mm_realloc */
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
@@ -817,7 +1064,10 @@ static void eval_mm_speed(void *ptr)
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            mm_free(block);
+            if (sized_free)
+		mm_free_sized(block, trace->ops[i].size);
+            else
+		mm_free(block);
             break;
 
 	default:
@@ -825,6 +1075,745 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+#ifdef THREADS
+/*
+ * mt_verify - Exits with an error unless the first size bytes of p all
+ *     hold pattern, as the thread that owns the block left them
+ */
+static void mt_verify(char *p, int size, char pattern, char *fn)
+{
+    char msg[MAXLINE];
+    int j;
+
+    for (j = 0; j < size; j++) {
+	if (p[j] != pattern) {
+	    sprintf(msg, "ERROR: block data overwritten in %s", fn);
+	    app_error(msg);
+	}
+    }
+}
+
+/*
+ * replay_thread - Run by each thread of eval_mm_threads: replays the
+ *     trace MT_REPS times on the shared heap, freeing what it allocated.
+ *     In a checked run each block is filled with a pattern of the thread
+ *     and of its id, which must still be there when it is reallocated or
+ *     freed.
+ */
+static void *replay_thread(void *ptr)
+{
+    thread_t *t = (thread_t *)ptr;
+    trace_t *trace = t->trace;
+    int i, r, index, size;
+    char *p;
+
+    for (r = 0; r < MT_REPS; r++) {
+	for (i = 0;  i < trace->num_ops;  i++) {
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    p = t->blocks[index];
+	    switch (trace->ops[i].type) {
+	    case ALLOC: /* mm_malloc */
+		if ((p = mm_malloc(size)) == NULL)
+		    app_error("mm_malloc error in eval_mm_threads");
+		break;
+
+	    case CALLOC: /* mm_calloc */
+		if ((p = mm_calloc(1, size)) == NULL)
+		    app_error("mm_calloc error in eval_mm_threads");
+		if (t->check)
+		    mt_verify(p, size, 0, "eval_mm_threads (mm_calloc)");
+		break;
+
+	    case MEMALIGN: /* mm_memalign */
+		if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+		    app_error("mm_memalign error in eval_mm_threads");
+		break;
+
+	    case REALLOC: /* mm_realloc */
+		if ((p = mm_realloc(p, size)) == NULL)
+		    app_error("mm_realloc error in eval_mm_threads");
+		if (t->check)
+		    mt_verify(p, size < t->sizes[index] ? size : t->sizes[index],
+			      MT_PATTERN(t->id, index), "eval_mm_threads (mm_realloc)");
+		break;
+
+	    case FREE: /* mm_free */
+		if (t->check)
+		    mt_verify(p, t->sizes[index], MT_PATTERN(t->id, index),
+			      "eval_mm_threads (mm_free)");
+		if (sized_free)
+		    mm_free_sized(p, size);
+		else
+		    mm_free(p);
+		continue;
+	    }
+	    t->blocks[index] = p;
+	    if (t->check) {
+		memset(p, MT_PATTERN(t->id, index), size);
+		t->sizes[index] = size;
+	    }
+	}
+    }
+    return NULL;
+}
+
+/*
+ * eval_mm_threads - Returns the wall clock time nthreads threads take
+ *     to replay the trace at the same time on a fresh heap, checking the
+ *     data of every block if check is set
+ */
+static double eval_mm_threads(trace_t *trace, int nthreads, int check)
+{
+    pthread_t *tids;
+    thread_t *args;
+    struct timespec start, end;
+    int i;
+
+    tids = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+    args = (thread_t *)malloc(nthreads * sizeof(thread_t));
+    if (tids == NULL || args == NULL)
+	unix_error("malloc failed in eval_mm_threads");
+    for (i = 0; i < nthreads; i++) {
+	args[i].trace = trace;
+	args[i].id = i;
+	args[i].check = check;
+	args[i].blocks = calloc(trace->num_ids, sizeof(char *));
+	args[i].sizes = calloc(trace->num_ids, sizeof(int));
+	if (args[i].blocks == NULL || args[i].sizes == NULL)
+	    unix_error("calloc failed in eval_mm_threads");
+    }
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_threads");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < nthreads; i++)
+	if (pthread_create(&tids[i], NULL, replay_thread, &args[i]) != 0)
+	    unix_error("pthread_create failed in eval_mm_threads");
+    for (i = 0; i < nthreads; i++)
+	pthread_join(tids[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (i = 0; i < nthreads; i++) {
+	free(args[i].blocks);
+	free(args[i].sizes);
+    }
+    free(args);
+    free(tids);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * printthreads - prints the throughput of each trace, and of all of
+ *     them, when replayed by 1 to max_threads threads at once
+ */
+static void printthreads(char **tracefiles, int n, int max_threads)
+{
+    double *secs, *ops, best, t;
+    trace_t *trace;
+    int i, k, run;
+
+    secs = (double *)calloc(max_threads + 1, sizeof(double));
+    ops = (double *)calloc(max_threads + 1, sizeof(double));
+    if (secs == NULL || ops == NULL)
+	unix_error("calloc failed in printthreads");
+
+    printf("Throughput of mm malloc in 1 to %d threads (Kops):\n", max_threads);
+    printf("%5s", "trace");
+    for (k = 1; k <= max_threads; k++)
+	printf("%9d", k);
+    printf("\n");
+    for (i = 0; i < n; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+	printf("%2d   ", i);
+	for (k = 1; k <= max_threads; k++) {
+	    eval_mm_threads(trace, k, 1);
+	    best = DBL_MAX;
+	    for (run = 0; run < MT_RUNS; run++)
+		if ((t = eval_mm_threads(trace, k, 0)) < best)
+		    best = t;
+	    secs[k] += best;
+	    ops[k] += (double)k * MT_REPS * trace->num_ops;
+	    printf("%9.0f", (double)k * MT_REPS * trace->num_ops / (best * 1e3));
+	}
+	printf("\n");
+	free_trace(trace);
+    }
+    printf("Total");
+    for (k = 1; k <= max_threads; k++)
+	printf("%9.0f", ops[k] / (secs[k] * 1e3));
+    printf("\n\n");
+    free(secs);
+    free(ops);
+}
+
+/*
+ * printarenas - prints the throughput of all the traces together when
+ *     replayed by 1 to max_threads threads at once, for each number of
+ *     arenas from 1 to max_arenas
+ */
+static void printarenas(char **tracefiles, int n, int max_threads, int max_arenas)
+{
+    trace_t **traces;
+    double secs, ops, best, t;
+    int i, k, a, run;
+
+    if ((traces = (trace_t **)malloc(n * sizeof(trace_t *))) == NULL)
+	unix_error("malloc failed in printarenas");
+    for (i = 0; i < n; i++)
+	traces[i] = read_trace(tracedir, tracefiles[i]);
+
+    printf("Throughput of mm malloc by number of arenas and threads (Kops):\n");
+    printf("%6s", "arenas");
+    for (k = 1; k <= max_threads; k++)
+	printf("%9d", k);
+    printf("\n");
+    for (a = 1; a <= max_arenas; a++) {
+	mm_set_arenas(a);
+	printf("%6d", a);
+	for (k = 1; k <= max_threads; k++) {
+	    secs = ops = 0;
+	    for (i = 0; i < n; i++) {
+		eval_mm_threads(traces[i], k, 1);
+		best = DBL_MAX;
+		for (run = 0; run < MT_RUNS; run++)
+		    if ((t = eval_mm_threads(traces[i], k, 0)) < best)
+			best = t;
+		secs += best;
+		ops += (double)k * MT_REPS * traces[i]->num_ops;
+	    }
+	    printf("%9.0f", ops / (secs * 1e3));
+	}
+	printf("\n");
+    }
+    printf("\n");
+
+    for (i = 0; i < n; i++)
+	free_trace(traces[i]);
+    free(traces);
+}
+
+/*
+ * produce_thread - Allocates a block for each allocation request of the
+ *     trace, MT_REPS times over, and passes it to the consumer. A NULL
+ *     block tells the consumer to stop. In a checked run the block is
+ *     filled with a pattern of the pair and of the block number.
+ */
+static void *produce_thread(void *ptr)
+{
+    pipe_t *pipe = (pipe_t *)ptr;
+    trace_t *trace = pipe->trace;
+    unsigned long head = 0;
+    int i, r, size = 0;
+    char *p;
+
+    for (r = 0; r <= MT_REPS; r++) {
+	for (i = 0; i < trace->num_ops; i++) {
+	    if (r == MT_REPS)
+		p = NULL;
+	    else if (trace->ops[i].type == FREE)
+		continue;
+	    else if ((p = mm_malloc(size = trace->ops[i].size)) == NULL)
+		app_error("mm_malloc error in eval_mm_pipes");
+	    else if (pipe->check)
+		memset(p, MT_PATTERN(pipe->id, head), size);
+	    while (head - __atomic_load_n(&pipe->tail, __ATOMIC_ACQUIRE) == PIPE_SLOTS)
+		sched_yield();
+	    pipe->slots[head % PIPE_SLOTS] = p;
+	    pipe->sizes[head % PIPE_SLOTS] = size;
+	    __atomic_store_n(&pipe->head, ++head, __ATOMIC_RELEASE);
+	    if (p == NULL)
+		return NULL;
+	}
+    }
+    return NULL;
+}
+
+/*
+ * consume_thread - Checks and frees the blocks the producer passes until
+ *     it gets NULL
+ */
+static void *consume_thread(void *ptr)
+{
+    pipe_t *pipe = (pipe_t *)ptr;
+    unsigned long tail = 0;
+    int size;
+    char *p, pattern;
+
+    for (;;) {
+	while (__atomic_load_n(&pipe->head, __ATOMIC_ACQUIRE) == tail)
+	    sched_yield();
+	p = pipe->slots[tail % PIPE_SLOTS];
+	size = pipe->sizes[tail % PIPE_SLOTS];
+	pattern = MT_PATTERN(pipe->id, tail);
+	__atomic_store_n(&pipe->tail, ++tail, __ATOMIC_RELEASE);
+	if (p == NULL)
+	    return NULL;
+	if (pipe->check)
+	    mt_verify(p, size, pattern, "eval_mm_pipes");
+	mm_free(p);
+    }
+}
+
+/*
+ * eval_mm_pipes - Returns the wall clock time npipes producer/consumer
+ *     pairs take to allocate and free the blocks of the trace on a fresh
+ *     heap, each block being freed by another thread than its producer,
+ *     checking the data of every block if check is set
+ */
+static double eval_mm_pipes(trace_t *trace, int npipes, int check)
+{
+    pthread_t *tids;
+    pipe_t *pipes;
+    struct timespec start, end;
+    int i;
+
+    tids = (pthread_t *)malloc(2 * npipes * sizeof(pthread_t));
+    pipes = (pipe_t *)calloc(npipes, sizeof(pipe_t));
+    if (tids == NULL || pipes == NULL)
+	unix_error("malloc failed in eval_mm_pipes");
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_pipes");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < npipes; i++) {
+	pipes[i].trace = trace;
+	pipes[i].id = i;
+	pipes[i].check = check;
+	if (pthread_create(&tids[2 * i], NULL, produce_thread, &pipes[i]) != 0 ||
+	    pthread_create(&tids[2 * i + 1], NULL, consume_thread, &pipes[i]) != 0)
+	    unix_error("pthread_create failed in eval_mm_pipes");
+    }
+    for (i = 0; i < 2 * npipes; i++)
+	pthread_join(tids[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    free(pipes);
+    free(tids);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * printpipes - prints the throughput, in mallocs plus frees, of 1 to
+ *     max_pipes producer/consumer pairs allocating the blocks of each trace
+ */
+static void printpipes(char **tracefiles, int n, int max_pipes)
+{
+    double *secs, *ops, best, t, reqs;
+    trace_t *trace;
+    int i, k, run;
+
+    secs = (double *)calloc(max_pipes + 1, sizeof(double));
+    ops = (double *)calloc(max_pipes + 1, sizeof(double));
+    if (secs == NULL || ops == NULL)
+	unix_error("calloc failed in printpipes");
+
+    printf("Throughput of mm malloc in 1 to %d producer/consumer pairs (Kops):\n",
+	   max_pipes);
+    printf("%5s", "trace");
+    for (k = 1; k <= max_pipes; k++)
+	printf("%9d", k);
+    printf("\n");
+    for (i = 0; i < n; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+	for (reqs = 0, k = 0; k < trace->num_ops; k++)
+	    if (trace->ops[k].type != FREE)
+		reqs += 2;
+	printf("%2d   ", i);
+	for (k = 1; k <= max_pipes; k++) {
+	    eval_mm_pipes(trace, k, 1);
+	    best = DBL_MAX;
+	    for (run = 0; run < MT_RUNS; run++)
+		if ((t = eval_mm_pipes(trace, k, 0)) < best)
+		    best = t;
+	    secs[k] += best;
+	    ops[k] += k * MT_REPS * reqs;
+	    printf("%9.0f", k * MT_REPS * reqs / (best * 1e3));
+	}
+	printf("\n");
+	free_trace(trace);
+    }
+    printf("Total");
+    for (k = 1; k <= max_pipes; k++)
+	printf("%9.0f", ops[k] / (secs[k] * 1e3));
+    printf("\n\n");
+    free(secs);
+    free(ops);
+}
+#endif
+
+/*
+ * eval_batch_valid - Allocates BATCH_BLOCKS blocks of size bytes with
+ *     mm_malloc_batch, n at a time, checks them like eval_mm_valid does,
+ *     and frees them with mm_free_batch
+ */
+static int eval_batch_valid(size_t size, int n, char **blocks, range_t **ranges)
+{
+    int i, j, k;
+
+    mem_reset_brk();
+    clear_ranges(ranges);
+    if (mm_init() < 0) {
+	malloc_error(0, 0, "mm_init failed.");
+	return 0;
+    }
+    for (i = 0; i < BATCH_BLOCKS; i += n) {
+	k = (BATCH_BLOCKS - i < n) ? BATCH_BLOCKS - i : n;
+	if (mm_malloc_batch(size, k, (void **)(blocks + i)) != k) {
+	    malloc_error(0, i, "mm_malloc_batch failed.");
+	    return 0;
+	}
+	for (j = i; j < i + k; j++) {
+	    if (add_range(ranges, blocks[j], size, 0, j) == 0)
+		return 0;
+	    memset(blocks[j], j & 0xFF, size);
+	}
+    }
+    for (i = 0; i < BATCH_BLOCKS; i += n) {
+	k = (BATCH_BLOCKS - i < n) ? BATCH_BLOCKS - i : n;
+	for (j = i; j < i + k; j++)
+	    remove_range(ranges, blocks[j]);
+	mm_free_batch((void **)(blocks + i), k);
+    }
+    return 1;
+}
+
+/*
+ * eval_mm_batch - Returns the time taken by BATCH_ROUNDS rounds, each
+ *     allocating BATCH_BLOCKS blocks of size bytes, then freeing them in
+ *     the same order, n at a time, by batches or by single calls
+ */
+static double eval_mm_batch(size_t size, int n, int batched, char **blocks)
+{
+    struct timespec start, end;
+    int r, i, j, k;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_batch");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (r = 0; r < BATCH_ROUNDS; r++) {
+	for (i = 0; i < BATCH_BLOCKS; i += n) {
+	    k = (BATCH_BLOCKS - i < n) ? BATCH_BLOCKS - i : n;
+	    if (batched) {
+		if (mm_malloc_batch(size, k, (void **)(blocks + i)) != k)
+		    app_error("mm_malloc_batch error in eval_mm_batch");
+	    }
+	    else {
+		for (j = i; j < i + k; j++)
+		    if ((blocks[j] = mm_malloc(size)) == NULL)
+			app_error("mm_malloc error in eval_mm_batch");
+	    }
+	}
+	for (i = 0; i < BATCH_BLOCKS; i += n) {
+	    k = (BATCH_BLOCKS - i < n) ? BATCH_BLOCKS - i : n;
+	    if (batched)
+		mm_free_batch((void **)(blocks + i), k);
+	    else
+		for (j = i; j < i + k; j++)
+		    mm_free(blocks[j]);
+	}
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * printbatch - prints the throughput, in mallocs plus frees, of single
+ *     calls and of batches of max_batch blocks, for a few block sizes
+ */
+static void printbatch(int max_batch)
+{
+    static const size_t sizes[] = {16, 64, 200, 1000, 4000};
+    double best[2], t, ops = 2.0 * BATCH_ROUNDS * BATCH_BLOCKS;
+    range_t *ranges = NULL;
+    char **blocks;
+    int i, b, run;
+
+    if ((blocks = (char **)malloc(BATCH_BLOCKS * sizeof(char *))) == NULL)
+	unix_error("malloc failed in printbatch");
+
+    printf("Throughput of mm malloc with single calls and batches of %d (Kops):\n",
+	   max_batch);
+    printf("%5s%9s%9s\n", "size", "single", "batch");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+	if (!eval_batch_valid(sizes[i], max_batch, blocks, &ranges))
+	    break;
+	for (b = 0; b < 2; b++) {
+	    best[b] = DBL_MAX;
+	    for (run = 0; run < MT_RUNS; run++)
+		if ((t = eval_mm_batch(sizes[i], max_batch, b, blocks)) < best[b])
+		    best[b] = t;
+	}
+	printf("%5lu%9.0f%9.0f\n", (unsigned long)sizes[i],
+	       ops / (best[0] * 1e3), ops / (best[1] * 1e3));
+    }
+    printf("\n");
+    clear_ranges(&ranges);
+    free(blocks);
+}
+
+/*
+ * eval_mm_regions - Replays the trace with regions in place of mm_malloc
+ *     and mm_free: each run of group allocations is cut from a region of
+ *     its own, destroyed once all of its blocks are freed. A realloc cuts
+ *     a new block and copies the old one. If check is set, the blocks are
+ *     filled when allocated and checked when freed. Returns the time the
+ *     replay took, or -1 if a block was overwritten.
+ */
+static double eval_mm_regions(trace_t *trace, int group, int check)
+{
+    int i, j, index, size, align, ngroups, old, g = -1, nalloc = 0;
+    int *owner, *live;
+    mm_region_t **regions;
+    struct timespec start, end;
+    char *p, *oldp;
+
+    ngroups = trace->num_ops / group + 1;
+    owner = (int *)malloc(trace->num_ids * sizeof(int));
+    live = (int *)calloc(ngroups, sizeof(int));
+    regions = (mm_region_t **)calloc(ngroups, sizeof(mm_region_t *));
+    if (owner == NULL || live == NULL || regions == NULL)
+	unix_error("malloc failed in eval_mm_regions");
+    for (i = 0; i < trace->num_ids; i++)
+	owner[i] = -1;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_regions");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+
+	old = -1;
+	if (trace->ops[i].type == FREE || trace->ops[i].type == REALLOC) {
+	    oldp = trace->blocks[index];
+	    old = owner[index];
+	    owner[index] = -1;
+	    if (check && old >= 0)
+		for (j = 0; j < trace->block_sizes[index]; j++)
+		    if (oldp[j] != (char)index) {
+			malloc_error(0, i, "region block overwritten");
+			return -1;
+		    }
+	}
+
+	/* Every group allocations, move on to a new region */
+	if (trace->ops[i].type != FREE && nalloc++ % group == 0) {
+	    if (g >= 0 && live[g] == 0) {
+		mm_region_destroy(regions[g]);
+		regions[g] = NULL;
+	    }
+	    if ((regions[++g] = mm_region_create(0)) == NULL)
+		app_error("mm_region_create error in eval_mm_regions");
+	}
+	if (trace->ops[i].type != FREE) {
+	    align = (trace->ops[i].type == MEMALIGN) ? trace->ops[i].align : 1;
+	    if ((p = mm_region_alloc(regions[g], size + align - 1)) == NULL)
+		app_error("mm_region_alloc error in eval_mm_regions");
+	    p = (char *)(((unsigned long)p + align - 1) & ~(unsigned long)(align - 1));
+	    if (trace->ops[i].type == CALLOC)
+		memset(p, 0, size);
+	    else if (old >= 0)
+		memcpy(p, oldp, size < trace->block_sizes[index] ?
+		       size : trace->block_sizes[index]);
+	    if (check)
+		memset(p, index & 0xFF, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    owner[index] = g;
+	    live[g]++;
+	}
+
+	/* A block freed or moved leaves its region, destroyed with its
+	   last block once no more allocations are cut from it */
+	if (old >= 0 && --live[old] == 0 && old != g) {
+	    mm_region_destroy(regions[old]);
+	    regions[old] = NULL;
+	}
+    }
+    for (i = 0; i <= g; i++)
+	mm_region_destroy(regions[i]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    free(regions);
+    free(live);
+    free(owner);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * printregions - prints the throughput and peak heap size of each trace,
+ *     replayed with mm_malloc and mm_free and then with a region per
+ *     group blocks
+ */
+static void printregions(char **tracefiles, int n, int group)
+{
+    double best[2], secs[2] = {0, 0}, ops = 0, t;
+    size_t peak[2];
+    struct timespec start, end;
+    speed_t speed_params;
+    trace_t *trace;
+    int i, run;
+
+    printf("Throughput of mm malloc with single calls and regions of %d blocks:\n",
+	   group);
+    printf("%5s%9s%9s%11s%11s\n", "trace", "Kops", "regions", "peak KB", "regions");
+    for (i = 0; i < n; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+	if (eval_mm_regions(trace, group, 1) < 0) {
+	    free_trace(trace);
+	    break;
+	}
+	speed_params.trace = trace;
+	best[0] = best[1] = DBL_MAX;
+	for (run = 0; run < MT_RUNS; run++) {
+	    clock_gettime(CLOCK_MONOTONIC, &start);
+	    eval_mm_speed(&speed_params);
+	    clock_gettime(CLOCK_MONOTONIC, &end);
+	    t = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	    if (t < best[0])
+		best[0] = t;
+	}
+	peak[0] = mem_peak_heapsize();
+	for (run = 0; run < MT_RUNS; run++)
+	    if ((t = eval_mm_regions(trace, group, 0)) < best[1])
+		best[1] = t;
+	peak[1] = mem_peak_heapsize();
+	secs[0] += best[0];
+	secs[1] += best[1];
+	ops += trace->num_ops;
+	printf("%2d   %9.0f%9.0f%11lu%11lu\n", i,
+	       trace->num_ops / (best[0] * 1e3), trace->num_ops / (best[1] * 1e3),
+	       (unsigned long)(peak[0] >> 10), (unsigned long)(peak[1] >> 10));
+	free_trace(trace);
+    }
+    printf("Total%9.0f%9.0f\n\n", ops / (secs[0] * 1e3), ops / (secs[1] * 1e3));
+}
+
+/*
+ * eval_pool_valid - Allocates POOL_OBJECTS objects of size bytes from a
+ *     pool, checks them like eval_mm_valid does, and frees them
+ */
+static int eval_pool_valid(size_t size, char **blocks, range_t **ranges)
+{
+    mm_pool_t *pool;
+    int i, j;
+
+    mem_reset_brk();
+    clear_ranges(ranges);
+    if (mm_init() < 0) {
+	malloc_error(0, 0, "mm_init failed.");
+	return 0;
+    }
+    if ((pool = mm_pool_create(size, 0)) == NULL) {
+	malloc_error(0, 0, "mm_pool_create failed.");
+	return 0;
+    }
+    for (i = 0; i < POOL_OBJECTS; i++) {
+	if ((blocks[i] = mm_pool_alloc(pool)) == NULL) {
+	    malloc_error(0, i, "mm_pool_alloc failed.");
+	    return 0;
+	}
+	if (add_range(ranges, blocks[i], size, 0, i) == 0)
+	    return 0;
+	memset(blocks[i], i & 0xFF, size);
+    }
+    for (i = 0; i < POOL_OBJECTS; i++) {
+	for (j = 0; j < size; j++)
+	    if (blocks[i][j] != (char)i) {
+		malloc_error(0, i, "pool object overwritten");
+		return 0;
+	    }
+	remove_range(ranges, blocks[i]);
+	mm_pool_free(pool, blocks[i]);
+    }
+    mm_pool_destroy(pool);
+    return 1;
+}
+
+/*
+ * eval_mm_pool - Returns the time taken by POOL_ROUNDS rounds, each
+ *     allocating POOL_OBJECTS objects of size bytes, freeing every other
+ *     one, allocating those again and freeing them all, with a pool or
+ *     with mm_malloc and mm_free
+ */
+static double eval_mm_pool(size_t size, int pooled, char **blocks)
+{
+    struct timespec start, end;
+    mm_pool_t *pool = NULL;
+    int r, i;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_pool");
+    if (pooled && (pool = mm_pool_create(size, 0)) == NULL)
+	app_error("mm_pool_create error in eval_mm_pool");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (r = 0; r < POOL_ROUNDS; r++) {
+	for (i = 0; i < POOL_OBJECTS; i++)
+	    if ((blocks[i] = pooled ? mm_pool_alloc(pool) : mm_malloc(size)) == NULL)
+		app_error("allocation error in eval_mm_pool");
+	for (i = 1; i < POOL_OBJECTS; i += 2)
+	    if (pooled)
+		mm_pool_free(pool, blocks[i]);
+	    else
+		mm_free(blocks[i]);
+	for (i = 1; i < POOL_OBJECTS; i += 2)
+	    if ((blocks[i] = pooled ? mm_pool_alloc(pool) : mm_malloc(size)) == NULL)
+		app_error("allocation error in eval_mm_pool");
+	for (i = 0; i < POOL_OBJECTS; i++)
+	    if (pooled)
+		mm_pool_free(pool, blocks[i]);
+	    else
+		mm_free(blocks[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    mm_pool_destroy(pool);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * printpool - prints the throughput, in allocations plus frees, and the
+ *     peak heap size of mm_malloc and of pools, for a few object sizes
+ */
+static void printpool(void)
+{
+    static const size_t sizes[] = {16, 24, 32, 64, 128, 256};
+    double best[2], t, ops = 3.0 * POOL_ROUNDS * POOL_OBJECTS;
+    size_t peak[2];
+    range_t *ranges = NULL;
+    char **blocks;
+    int i, p, run;
+
+    if ((blocks = (char **)malloc(POOL_OBJECTS * sizeof(char *))) == NULL)
+	unix_error("malloc failed in printpool");
+
+    printf("Throughput of mm malloc with single calls and pools of %d objects:\n",
+	   POOL_OBJECTS);
+    printf("%5s%9s%9s%11s%11s\n", "size", "Kops", "pool", "peak KB", "pool");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+	if (!eval_pool_valid(sizes[i], blocks, &ranges))
+	    break;
+	for (p = 0; p < 2; p++) {
+	    best[p] = DBL_MAX;
+	    for (run = 0; run < MT_RUNS; run++)
+		if ((t = eval_mm_pool(sizes[i], p, blocks)) < best[p])
+		    best[p] = t;
+	    peak[p] = mem_peak_heapsize();
+	}
+	printf("%5lu%9.0f%9.0f%11lu%11lu\n", (unsigned long)sizes[i],
+	       ops / (best[0] * 1e3), ops / (best[1] * 1e3),
+	       (unsigned long)(peak[0] >> 10), (unsigned long)(peak[1] >> 10));
+    }
+    printf("\n");
+    clear_ranges(&ranges);
+    free(blocks);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -847,6 +1836,22 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    trace->blocks[trace->ops[i].index] = p;
 	    break;
 
+        case CALLOC: /* calloc */
+	    if ((p = calloc(1, trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc calloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
+        case MEMALIGN: /* aligned_alloc */
+	    if ((p = aligned_alloc(trace->ops[i].align, trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc aligned_alloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
 	case REALLOC: /* realloc */
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[trace->ops[i].index];
@@ -891,6 +1896,22 @@ static void eval_libc_speed(void *ptr)
 	    trace->blocks[index] = p;
 	    break;
 
+        case CALLOC: /* calloc */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = calloc(1, size)) == NULL)
+		unix_error("calloc failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+        case MEMALIGN: /* aligned_alloc */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = aligned_alloc(trace->ops[i].align, size)) == NULL)
+		unix_error("aligned_alloc failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
 	case REALLOC: /* realloc */
 	    index = trace->ops[i].index;
 	    newsize = trace->ops[i].size;
@@ -910,6 +1931,39 @@ static void eval_libc_speed(void *ptr)
     }
 }
 
+/*
+ * count_misses - Run f(argp) once and return the number of hardware
+ *    cache misses it caused, or -1 if the counters are not available.
+ */
+static double count_misses(void (*f)(void *), void *argp)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    long long count;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    if ((fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0)) >= 0) {
+	ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	f(argp);
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	if (read(fd, &count, sizeof(count)) != sizeof(count))
+	    count = -1;
+	close(fd);
+	return (double)count;
+    }
+#endif
+    f(argp);
+    return -1;
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
@@ -972,6 +2026,83 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printsearch - prints, per operation, how many scattered free block
+ *     headers and packed index entries the free block searches of mm.c
+ *     read, and the hardware cache misses when they can be counted
+ */
+static void printsearch(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%5s%10s%10s%10s\n", "trace", "probes/op", "scans/op", "misses/op");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%13s%10s%10s\n", i, "-", "-", "-");
+	    continue;
+	}
+	printf("%2d%13.2f%10.2f", 
+	       i,
+	       stats[i].mm.fit_probes / stats[i].ops,
+	       stats[i].mm.index_scans / stats[i].ops);
+	if (stats[i].misses >= 0)
+	    printf("%10.2f\n", stats[i].misses / stats[i].ops);
+	else
+	    printf("%10s\n", "-");
+    }
+}
+
+/*
+ * printrealloc - prints how many mm_realloc calls of the last speed run
+ *     kept their block (copies avoided), how many moved it, and the
+ *     bytes those moves copied
+ */
+static void printrealloc(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%5s%10s%10s%12s\n", "trace", "in place", "moved", "bytes");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%13s%10s%12s\n", i, "-", "-", "-");
+	    continue;
+	}
+	printf("%2d%13lu%10lu%12lu\n", 
+	       i,
+	       stats[i].mm.realloc_inplace,
+	       stats[i].mm.realloc_moves,
+	       stats[i].mm.copy_bytes);
+    }
+}
+
+/*
+ * printheap - prints the peak and final heap size of the util run,
+ *     regions mapped apart from the heap included,
+ *     how much of the peak mm.c gave back by the end, how much of
+ *     the final heap is resident in physical memory, and how much of
+ *     the heap memlib still has committed
+ */
+static void printheap(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%5s%12s%12s%12s%12s%12s\n", "trace", "peak", "final", "returned",
+	   "resident", "committed");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%15s%12s%12s%12s%12s\n", i, "-", "-", "-", "-", "-");
+	    continue;
+	}
+	printf("%2d%15lu%12lu%12lu%12lu%12lu\n", 
+	       i,
+	       (unsigned long)stats[i].peak_heap,
+	       (unsigned long)stats[i].final_heap,
+	       (unsigned long)(stats[i].peak_heap - stats[i].final_heap),
+	       (unsigned long)stats[i].resident,
+	       (unsigned long)stats[i].committed);
+    }
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1004,14 +2135,22 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValHOS] [-f <file>] [-t <dir>] [-T <n>] [-A <n>] [-P <n>] [-B <n>] [-R <n>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-A <n>     Measure throughput with 1 to <n> arenas (THREADS=1 builds).\n");
+    fprintf(stderr, "\t-B <n>     Compare batches of <n> blocks to single calls.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H         Back the heap with transparent huge pages.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-O         Compare object pools to single calls.\n");
+    fprintf(stderr, "\t-P <n>     Measure 1 to <n> producer/consumer pairs (THREADS=1 builds).\n");
+    fprintf(stderr, "\t-R <n>     Compare regions of <n> blocks to single calls.\n");
+    fprintf(stderr, "\t-S         Free blocks with their size (mm_free_sized).\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Measure throughput in 1 to <n> threads (THREADS=1 builds).\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
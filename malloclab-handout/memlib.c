@@ -2,7 +2,18 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ * The heap lives in MAX_HEAP bytes of address space reserved up front
+ * without access rights. Pages are committed, made readable and writable,
+ * in units of MEM_COMMIT_UNIT bytes as the brk moves up, and released
+ * again when it moves down.
+ *
+ * The reserved range is split into MAX_ARENAS spans of ARENA_SPAN bytes,
+ * each with a brk of its own, so that the arenas of a THREADS build grow
+ * and shrink independently. mem_sbrk works on the first one. In a THREADS
+ * build the functions that move a brk or map a region take a lock.
  */
+#define _GNU_SOURCE         /* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,28 +21,103 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#ifdef THREADS
+#include <pthread.h>
+#endif
 
 #include "memlib.h"
 #include "config.h"
 
+#define MEM_COMMIT_UNIT (1 << 16) /* bytes committed at a time */
+#define MEM_HUGE_PAGE (1 << 21)   /* transparent huge page size */
+#define MEM_RETAIN (1 << 20)      /* committed bytes kept above the brk on a shrink */
+
+/* The heap of one arena */
+typedef struct {
+    char *start_brk;         /* points to first byte of heap */
+    char *brk;               /* points to last byte of heap */
+    char *max_addr;          /* largest legal heap address */
+    char *commit_brk;        /* end of the committed part of the heap */
+    char *dirty_brk;         /* pages from here on were not used since they were zeroed */
+} mem_heap_t;
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static mem_heap_t mem_heaps[MAX_ARENAS]; /* heaps of the arenas, in address order */
+static size_t mem_commit_unit; /* granularity of commits, a power of two */
+static void *mem_reserve_lo; /* start of the reserved address range */
+static size_t mem_reserve_len; /* length of that range */
+static int mem_huge;         /* back the heap with transparent huge pages */
+static size_t mem_peak;      /* largest heap plus mapped size since the last reset */
+
+/* Regions mapped apart from the heap by mem_map */
+typedef struct mem_region {
+    char *lo;                /* first byte of the region */
+    size_t len;              /* length of the region, a multiple of the page size */
+    struct mem_region *next;
+} mem_region_t;
+
+static mem_region_t *mem_regions; /* regions currently mapped */
+static size_t mem_mapped_bytes;   /* total length of those regions */
+
+static char *mem_table_lo;        /* table mapped by mem_map_table, if any */
+static size_t mem_table_len;      /* its length */
+
+#ifdef THREADS
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER; /* guards the brks and regions */
+#define MEM_LOCK() pthread_mutex_lock(&mem_lock)
+#define MEM_UNLOCK() pthread_mutex_unlock(&mem_lock)
+#else
+#define MEM_LOCK()
+#define MEM_UNLOCK()
+#endif
+
+static void mem_update_peak(void);
+static int mem_commit(mem_heap_t *h, char *brk, int shrink);
+static size_t mem_count_resident(char *lo, size_t len);
+static mem_region_t **mem_find_region(void *lo);
+
+/*
+ * mem_use_hugepages - asks mem_init to back the heap with transparent
+ *    huge pages, where the system supports them
+ */
+void mem_use_hugepages(int on)
+{
+    mem_huge = on;
+}
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    size_t align = mem_huge ? MEM_HUGE_PAGE : mem_pagesize();
+    char *start;
+    int i;
+
+    /* reserve the address space we will use to model the available VM,
+       with room to align its start */
+    mem_reserve_len = MAX_HEAP + align;
+    mem_reserve_lo = mmap(NULL, mem_reserve_len, PROT_NONE,
+			  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_reserve_lo == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error: %s\n", strerror(errno));
 	exit(1);
     }
+    start = (char *)(((size_t)mem_reserve_lo + align - 1) & ~(align - 1));
+#ifdef MADV_HUGEPAGE
+    if (mem_huge && madvise(start, MAX_HEAP, MADV_HUGEPAGE) < 0)
+	fprintf(stderr, "mem_init_vm: no huge pages: %s\n", strerror(errno));
+#endif
 
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    for (i = 0; i < MAX_ARENAS; i++) {
+	mem_heaps[i].start_brk = start + i * ARENA_SPAN;
+	mem_heaps[i].max_addr = mem_heaps[i].start_brk + ARENA_SPAN; /* max legal heap address */
+	mem_heaps[i].brk = mem_heaps[i].start_brk;        /* heap is empty initially */
+	mem_heaps[i].commit_brk = mem_heaps[i].start_brk; /* nothing committed yet */
+	mem_heaps[i].dirty_brk = mem_heaps[i].start_brk;  /* nor used */
+    }
+    mem_commit_unit = mem_huge ? MEM_HUGE_PAGE : MEM_COMMIT_UNIT;
+    mem_peak = 0;
 }
 
 /* 
@@ -39,57 +125,417 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(mem_reserve_lo, mem_reserve_len);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap.
+ *    The committed pages stay committed for the next run.
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    int i;
+
+    for (i = 0; i < MAX_ARENAS; i++)
+	mem_heaps[i].brk = mem_heaps[i].start_brk;
+    while (mem_regions != NULL)
+	mem_unmap(mem_regions->lo);
+    mem_peak = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area.
+ *    The heap only shrinks through mem_arena_trim, so a negative incr
+ *    fails like a request that does not fit.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(intptr_t incr) 
 {
-    char *old_brk = mem_brk;
+    return mem_arena_sbrk(0, incr);
+}
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+/*
+ * mem_arena_sbrk - mem_sbrk on the heap of the given arena
+ */
+void *mem_arena_sbrk(int arena, intptr_t incr)
+{
+    mem_heap_t *h = &mem_heaps[arena];
+    char *old_brk;
+
+    MEM_LOCK();
+    old_brk = h->brk;
+    if ((incr < 0) || (incr > h->max_addr - h->brk) ||
+	(mem_commit(h, h->brk + incr, 0) < 0)) {
+	MEM_UNLOCK();
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
-    mem_brk += incr;
+    h->brk += incr;
+    if (h->brk > h->dirty_brk)
+	h->dirty_brk = h->brk;
+    mem_update_peak();
+    MEM_UNLOCK();
     return (void *)old_brk;
 }
 
+/*
+ * mem_arena_trim - shrinks the heap of the given arena by decr bytes,
+ *    but never below its start, and returns its new end
+ */
+void *mem_arena_trim(int arena, size_t decr)
+{
+    mem_heap_t *h = &mem_heaps[arena];
+
+    MEM_LOCK();
+    if (decr > (size_t)(h->brk - h->start_brk)) {
+	MEM_UNLOCK();
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_arena_trim failed. Heap shrunk below its start...\n");
+	return (void *)-1;
+    }
+    h->brk -= decr;
+    mem_commit(h, h->brk, 1);
+    MEM_UNLOCK();
+    return (void *)h->brk;
+}
+
+/*
+ * mem_commit - makes the heap h committed up to brk, rounded up to the
+ *    commit unit. When shrink is set, the committed units more than
+ *    MEM_RETAIN bytes above that are released, so a heap that shrinks
+ *    and grows back does not pay for it every time. Returns -1 if the
+ *    pages cannot be committed.
+ */
+static int mem_commit(mem_heap_t *h, char *brk, int shrink)
+{
+    char *end = h->start_brk +
+	((brk - h->start_brk + mem_commit_unit - 1) & ~(mem_commit_unit - 1));
+
+    if (end > h->max_addr)
+	end = h->max_addr;
+    if (end > h->commit_brk) {
+	if (mprotect(h->commit_brk, end - h->commit_brk,
+		     PROT_READ | PROT_WRITE) < 0)
+	    return -1;
+	h->commit_brk = end;
+    }
+    else if (shrink && h->commit_brk - end > MEM_RETAIN) {
+	end += MEM_RETAIN;
+#ifdef MADV_DONTNEED
+	madvise(end, h->commit_brk - end, MADV_DONTNEED);
+	if (h->dirty_brk > end)
+	    h->dirty_brk = end;
+#endif
+	mprotect(end, h->commit_brk - end, PROT_NONE);
+	h->commit_brk = end;
+    }
+    return 0;
+}
+
+/*
+ * mem_map - maps a region of at least len bytes apart from the heap
+ *    and returns its page-aligned start, or NULL if it fails
+ */
+void *mem_map(size_t len)
+{
+    size_t page = mem_pagesize();
+    mem_region_t *r;
+    void *lo;
+
+    len = (len + page - 1) & ~(page - 1);
+    if ((r = malloc(sizeof(mem_region_t))) == NULL)
+	return NULL;
+    lo = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+	      -1, 0);
+    if (lo == MAP_FAILED) {
+	free(r);
+	return NULL;
+    }
+    r->lo = lo;
+    r->len = len;
+    MEM_LOCK();
+    r->next = mem_regions;
+    mem_regions = r;
+    mem_mapped_bytes += len;
+    mem_update_peak();
+    MEM_UNLOCK();
+    return lo;
+}
+
+/*
+ * mem_map_table - maps len bytes of zeroed memory apart from the heap for
+ *    the tables of the allocator, and returns their start or NULL if it
+ *    fails. Pages are only committed as they are touched, and they are
+ *    counted by mem_resident but not in the heap size. There is at most
+ *    one table, kept across mem_reset_brk.
+ */
+void *mem_map_table(size_t len)
+{
+    size_t page = mem_pagesize();
+    void *lo;
+
+    len = (len + page - 1) & ~(page - 1);
+    lo = mmap(NULL, len, PROT_READ | PROT_WRITE,
+	      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (lo == MAP_FAILED)
+	return NULL;
+    mem_table_lo = lo;
+    mem_table_len = len;
+    return lo;
+}
+
+/*
+ * mem_remap - resizes the region starting at lo to at least len bytes,
+ *    moving it if needed, and returns its new start or NULL if it fails.
+ *    The contents are kept up to the smaller of the two lengths.
+ */
+void *mem_remap(void *lo, size_t len)
+{
+    size_t page = mem_pagesize();
+    mem_region_t *r;
+    void *newlo;
+
+    len = (len + page - 1) & ~(page - 1);
+    MEM_LOCK();
+    r = *mem_find_region(lo);
+#ifdef MREMAP_MAYMOVE
+    if ((newlo = mremap(lo, r->len, len, MREMAP_MAYMOVE)) == MAP_FAILED) {
+	MEM_UNLOCK();
+	return NULL;
+    }
+#else
+    newlo = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+		 -1, 0);
+    if (newlo == MAP_FAILED) {
+	MEM_UNLOCK();
+	return NULL;
+    }
+    memcpy(newlo, lo, (len < r->len) ? len : r->len);
+    munmap(lo, r->len);
+#endif
+    mem_mapped_bytes += len - r->len;
+    r->lo = newlo;
+    r->len = len;
+    mem_update_peak();
+    MEM_UNLOCK();
+    return newlo;
+}
+
+/*
+ * mem_unmap - unmaps the region starting at lo
+ */
+void mem_unmap(void *lo)
+{
+    mem_region_t **rp, *r;
+
+    MEM_LOCK();
+    rp = mem_find_region(lo);
+    r = *rp;
+    mem_mapped_bytes -= r->len;
+    *rp = r->next;
+    MEM_UNLOCK();
+    munmap(r->lo, r->len);
+    free(r);
+}
+
+/*
+ * mem_mapped - returns the number of bytes in mapped regions
+ */
+size_t mem_mapped()
+{
+    return mem_mapped_bytes;
+}
+
+/*
+ * mem_in_region - returns 1 if [lo, hi] lies within one mapped region
+ */
+int mem_in_region(void *lo, void *hi)
+{
+    mem_region_t *r;
+
+    for (r = mem_regions; r != NULL; r = r->next)
+	if ((char *)lo >= r->lo && (char *)hi < r->lo + r->len)
+	    return 1;
+    return 0;
+}
+
+/*
+ * mem_find_region - returns the link pointing to the region starting at lo
+ */
+static mem_region_t **mem_find_region(void *lo)
+{
+    mem_region_t **rp = &mem_regions;
+
+    while ((*rp)->lo != (char *)lo)
+	rp = &(*rp)->next;
+    return rp;
+}
+
+/*
+ * mem_update_peak - records the current heap plus mapped size if it is
+ *    the largest so far
+ */
+static void mem_update_peak(void)
+{
+    size_t size = mem_heapsize() + mem_mapped_bytes;
+
+    if (size > mem_peak)
+	mem_peak = size;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
 void *mem_heap_lo()
 {
-    return (void *)mem_start_brk;
+    return (void *)mem_heaps[0].start_brk;
 }
 
 /* 
- * mem_heap_hi - return address of last heap byte
+ * mem_heap_hi - return address of last heap byte, in the last
+ *    arena that is not empty
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    int i = MAX_ARENAS - 1;
+
+    while (i > 0 && mem_heaps[i].brk == mem_heaps[i].start_brk)
+	i--;
+    return (void *)(mem_heaps[i].brk - 1);
 }
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_heapsize() - returns the heap size in bytes, over all arenas
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    size_t size = 0;
+    int i;
+
+    for (i = 0; i < MAX_ARENAS; i++)
+	size += mem_heaps[i].brk - mem_heaps[i].start_brk;
+    return size;
+}
+
+/*
+ * mem_arena_hi - return address of the last heap byte of an arena
+ */
+void *mem_arena_hi(int arena)
+{
+    return (void *)(mem_heaps[arena].brk - 1);
+}
+
+/*
+ * mem_arena_fresh - return the address from which the heap of an arena
+ *    was never handed out by mem_sbrk since its pages were last zeroed,
+ *    which mem_reset_brk does not do
+ */
+void *mem_arena_fresh(int arena)
+{
+    return (void *)mem_heaps[arena].dirty_brk;
+}
+
+/*
+ * mem_arena_size() - returns the heap size of an arena in bytes
+ */
+size_t mem_arena_size(int arena)
+{
+    return (size_t)(mem_heaps[arena].brk - mem_heaps[arena].start_brk);
+}
+
+/*
+ * mem_peak_heapsize() - returns the largest heap size in bytes since
+ *    the last reset, counting the mapped regions
+ */
+size_t mem_peak_heapsize()
+{
+    return mem_peak;
+}
+
+/*
+ * mem_decommit - tells the system that the pages of [lo, lo + len) are
+ *    no longer needed. They stay mapped and read back as zeros once
+ *    touched again. lo and len must be multiples of the page size.
+ */
+void mem_decommit(void *lo, size_t len)
+{
+#ifdef MADV_DONTNEED
+    if (madvise(lo, len, MADV_DONTNEED) < 0)
+	fprintf(stderr, "ERROR: mem_decommit failed: %s\n", strerror(errno));
+#endif
+}
+
+/*
+ * mem_resident - returns the number of heap, mapped and table bytes
+ *    backed by physical pages, or their size when the system cannot tell
+ */
+size_t mem_resident()
+{
+    size_t resident = 0;
+    mem_region_t *r;
+    int i;
+
+    for (i = 0; i < MAX_ARENAS; i++)
+	resident += mem_count_resident(mem_heaps[i].start_brk,
+				       mem_heaps[i].brk - mem_heaps[i].start_brk);
+
+    for (r = mem_regions; r != NULL; r = r->next)
+	resident += mem_count_resident(r->lo, r->len);
+    if (mem_table_lo != NULL)
+	resident += mem_count_resident(mem_table_lo, mem_table_len);
+    return resident;
+}
+
+/*
+ * mem_count_resident - returns the number of bytes of the pages
+ *    overlapping [lo, lo + len) that are backed by physical pages
+ */
+static size_t mem_count_resident(char *lo, size_t len)
+{
+#ifdef __linux__
+    size_t page = mem_pagesize();
+    char *first = (char *)((size_t)lo & ~(page - 1));
+    size_t npages = (lo + len - first + page - 1) / page;
+    unsigned char *vec;
+    size_t i, resident = 0;
+
+    if (npages == 0)
+	return 0;
+    if ((vec = malloc(npages)) == NULL || mincore(first, npages * page, vec) < 0) {
+	free(vec);
+	return len;
+    }
+    for (i = 0; i < npages; i++)
+	if (vec[i] & 1)
+	    resident += page;
+    free(vec);
+    return resident;
+#else
+    return len;
+#endif
+}
+
+/*
+ * mem_committed() - returns the number of heap bytes committed
+ */
+size_t mem_committed()
+{
+    size_t committed = 0;
+    int i;
+
+    for (i = 0; i < MAX_ARENAS; i++)
+	committed += mem_heaps[i].commit_brk - mem_heaps[i].start_brk;
+    return committed;
+}
+
+/*
+ * mem_reserved() - returns the number of bytes of address space
+ *    reserved for the heap
+ */
+size_t mem_reserved()
+{
+    return MAX_HEAP;
 }
 
 /*
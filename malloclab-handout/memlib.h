@@ -1,11 +1,29 @@
+#include <stdint.h>
 #include <unistd.h>
 
+void mem_use_hugepages(int on);
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
+void *mem_arena_sbrk(int arena, intptr_t incr);
+void *mem_arena_trim(int arena, size_t decr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+void *mem_arena_hi(int arena);
+void *mem_arena_fresh(int arena);
+size_t mem_arena_size(int arena);
+size_t mem_committed(void);
+size_t mem_reserved(void);
+size_t mem_peak_heapsize(void);
+void mem_decommit(void *lo, size_t len);
+size_t mem_resident(void);
+void *mem_map(size_t len);
+void *mem_map_table(size_t len);
+void *mem_remap(void *lo, size_t len);
+void mem_unmap(void *lo);
+size_t mem_mapped(void);
+int mem_in_region(void *lo, void *hi);
 size_t mem_pagesize(void);
 
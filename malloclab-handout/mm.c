@@ -1,16 +1,27 @@
- /*Explicit Allocator
- * In this solution, we have implemented an explicit free list
- * here we have added two new functions, delete and insert
- * which are called in the coalesce routine.
- * 
- * Here the data structure used by the free list is a doubly linked list.
+ /*Segregated Explicit Allocator
+ * Free blocks are kept in doubly linked lists, one per size class, and the
+ * large ones in a splay tree; make TLSF=1 keeps them in a two-level
+ * segregated fit index instead. Small freed blocks wait in quick lists
+ * before they are coalesced, huge requests get regions mapped apart from
+ * the heap, and with make SLABS=1 small requests are served from slabs.
+ * make OOB=1 and THREADS=1 build the other variants described next to
+ * their code.
  */
 
+#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#ifdef THREADS
+#include <pthread.h>
+#endif
 
+#include "config.h"
 #include "memlib.h"
 #include "mm.h"
 /*********************************************************
@@ -36,61 +47,450 @@ team_t team = {
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
 //* Basic macros: */
-#define WSIZE sizeof(void *) /* Word and header/footer size (bytes) */
+#define WSIZE 4              /* Word and header/footer size (bytes) */
 #define DSIZE (2 * WSIZE)    /* Doubleword size (bytes) */
-#define CHUNKSIZE (1 << 12)  /* Extend heap by this amount (bytes) */
-#define MINBLOCKSIZE 2 * DSIZE
+#define LSIZE 4              /* Free list link size (bytes) */
+#define GROW_MIN (1 << 10)   /* Smallest growth chunk of the heap (bytes) */
+#define GROW_MAX (1 << 16)   /* Largest growth chunk of the heap (bytes) */
+#define GROW_WINDOW 16       /* Requests between two heap growths that count as a burst */
+#ifndef DECOMMIT_MIN
+#define DECOMMIT_MIN (1 << 16)   /* Release the inner pages of free blocks this large */
+#endif
+#ifndef PURGE_BYTES
+#define PURGE_BYTES (1 << 20)    /* Look for such blocks after this many bytes are freed */
+#endif
+/* A pass walks the whole heap, so it waits for the heap size to be freed too */
+#define PURGE_DUE() (arena->dirty_bytes >= MAX(PURGE_BYTES, mem_arena_size(arena->id)))
+#define PURGE_STAMP(bp) (*(uint32_t *)((char *)(bp) + 2 * LSIZE)) /* Pass that saw bp free */
+#ifndef TRIM_THRESHOLD
+#define TRIM_THRESHOLD (1 << 17) /* Give back a wilderness of this many bytes or more */
+#endif
+/* A free block holds a header, two links and a footer */
+#define MINBLOCKSIZE ALIGN(DSIZE + 2 * LSIZE)
+#define MAXBLOCKSIZE ((size_t)UINT32_MAX & ~(DSIZE - 1)) /* Largest size a header holds */
+/* Size given to a block that keeps growing: a quarter more than asked */
+#define RESERVE(asize) MIN(ALIGN((asize) + (asize) / 4), MAXBLOCKSIZE)
+/* TLSF (make TLSF=1) splits sizes into power-of-two ranges and each range
+   linearly into SL_COUNT lists, with a bitmap per level of the non-empty
+   ones. Otherwise class k holds the sizes in [2^k, 2^(k+1)) times
+   MINCLASSSIZE and blocks of TREE_MIN bytes or more go to a splay tree
+   ordered by (size, address). */
+#ifdef TLSF
+#define SL_LOG2 3                     /* log2 of the second level lists per range */
+#define SL_COUNT (1 << SL_LOG2)
+#define SMALL_LOG2 8                  /* Sizes below 2^SMALL_LOG2 share first level 0 */
+#define SMALL_BLOCK (1 << SMALL_LOG2)
+#define FL_COUNT 25                   /* First level covers sizes up to 2^32 */
+#define NUM_CLASSES (FL_COUNT * SL_COUNT)
+#else
+#define NUM_CLASSES 6        /* Number of segregated free lists */
+#define MINCLASSSIZE 16      /* Upper bound (exclusive) of the sizes in class 0 is 2x this */
+#define TREE_MIN (MINCLASSSIZE << NUM_CLASSES) /* Smallest block kept in the tree (1 KiB) */
+#define INDEX_CAP 64         /* Blocks of a list that are also in its size index */
+#endif
 /*Max value of 2 values*/
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 
-/* Pack a size and allocated bit into a word */
-#define PACK(size, alloc) ((size) | (alloc))
+/* rounds p up to a multiple of align, a power of two */
+#define ALIGN_UP(p, align) (((uintptr_t)(p) + ((align) - 1)) & ~(uintptr_t)((align) - 1))
+
+/* Pack a size, allocated bit and previous-allocated bit into a word.
+   Sizes are multiples of ALIGNMENT, which leaves the low bits for flags. */
+#define PACK(size, alloc) ((uint32_t)(size) | (alloc))
+#define ALLOC 0x1      /* The block is allocated */
+#define PREV_ALLOC 0x2 /* The block before it is allocated */
+#define GROWN 0x4      /* The allocated block was already grown by mm_realloc */
+#define DECOMMITTED 0x4 /* The free block gave its inner pages back (same bit) */
 
 /* Read and write a word at address p. */
-#define GET(p) (*(uintptr_t *)(p))
-#define PUT(p, val) (*(uintptr_t *)(p) = (val))
+#define GET(p) (*(uint32_t *)(p))
+#define PUT(p, val) (*(uint32_t *)(p) = (val))
 
 /* Read the size and allocated fields from address p */
-#define GET_SIZE(p) (GET(p) & ~(DSIZE - 1))
-#define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_SIZE(p) ((size_t)(GET(p) & ~(DSIZE - 1)))
+#define GET_ALLOC(p) (GET(p) & ALLOC)
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+
+/* Update the previous-allocated bit of the header at address p */
+#define SET_PREV_ALLOC(p) PUT(p, GET(p) | PREV_ALLOC)
+#define CLEAR_PREV_ALLOC(p) PUT(p, GET(p) & ~PREV_ALLOC)
+#define GET_FLAGS(p) (GET(p) & (DSIZE - 1))
 
-/* Given block ptr bp, compute address of its header and footer */
+/* Given block ptr bp, compute address of its header and footer
+   (the footer only exists while the block is free), and of the footer
+   of the block before it */
+#ifdef OOB_TAGS
+/* With OOB_TAGS (make OOB=1) the words live in meta_tags, away from the
+   payloads, one per ALIGNMENT bytes of heap: the header of bp at the index
+   of bp and its footer just before the next header */
+#define META_INDEX(bp) ((size_t)((char *)(bp) - heap_lo) / ALIGNMENT)
+#define HDRP(bp) ((void *)&meta_tags[META_INDEX(bp)])
+#define FTRP(bp) ((void *)&meta_tags[META_INDEX(bp) + GET_SIZE(HDRP(bp)) / ALIGNMENT - 1])
+#define PREV_FTRP(bp) ((void *)&meta_tags[META_INDEX(bp) - 1])
+#else
 #define HDRP(bp) ((void *)(bp)-WSIZE)
 #define FTRP(bp) ((void *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+#define PREV_FTRP(bp) ((void *)(bp)-DSIZE)
+#endif
+/* Heap address where the footer of bp sits in the in-band layout, which
+   bounds the bytes of a free block that hold no bookkeeping */
+#define FTR_ADDR(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 
 //Additional Macros
 #define NEXT_BLK(bp) ((void *)(bp) + GET_SIZE(HDRP(bp)))
-#define PREV_BLK(bp) ((void *)(bp)-GET_SIZE((void *)(bp)-DSIZE))
+/* Only valid when the previous block is free */
+#define PREV_BLK(bp) ((void *)(bp)-GET_SIZE(PREV_FTRP(bp)))
+
+/* Convert between a block pointer and its link offset (0 stands for NULL,
+   the first heap bytes being padding that no block starts at). Counted in
+   ALIGNMENT units, 32 bits reach any block of a 32 GiB heap. */
+#define TO_OFF(bp) ((bp) ? (uint32_t)(((char *)(bp) - arena->heap_base) / ALIGNMENT) : 0)
+#define FROM_OFF(off) ((off) ? (void *)(arena->heap_base + (size_t)(off) * ALIGNMENT) : NULL)
+
+#define GET_NEXT_PTR(bp) FROM_OFF(GET((char *)(bp) + LSIZE))
+#define GET_PREV_PTR(bp) FROM_OFF(GET(bp))
+
+#define SET_NEXT_PTR(bp, qp) PUT((char *)(bp) + LSIZE, TO_OFF(qp))
+#define SET_PREV_PTR(bp, qp) PUT(bp, TO_OFF(qp))
+
+/* Free blocks in the tree reuse the two link words as child pointers */
+#define GET_LEFT(bp) GET_PREV_PTR(bp)
+#define GET_RIGHT(bp) GET_NEXT_PTR(bp)
+#define SET_LEFT(bp, qp) SET_PREV_PTR(bp, qp)
+#define SET_RIGHT(bp, qp) SET_NEXT_PTR(bp, qp)
+
+/* Slab macros. A slab is a heap block of one page cut into slots of one
+   class, with no header per slot; slab_map tells mm_free where slabs start. */
+#ifndef SLABS
+#define SLABS 0                       /* Build with make SLABS=1 to use slabs */
+#endif
+#define SLAB_SHIFT 12                 /* Slabs are one 4 KiB page */
+#define SLAB_SIZE (1 << SLAB_SHIFT)
+#define SLAB_MAX 128                  /* Largest request served from slabs */
+#define SLAB_CLASSES 8
+#define SLAB_WORDS 8                  /* 64-bit bitmap words, enough for 8-byte slots */
+#define SLAB_PAGES (MAX_HEAP / SLAB_SIZE + 1)
+/* Slab class a heap block of bsize bytes counts in, for blocks up to SLAB_MAX + DSIZE */
+#define DEMAND_CLASS(bsize) slab_class(MIN((bsize) - WSIZE, SLAB_MAX))
+
+/* Page number of p counted from the page of the heap start */
+#define SLAB_INDEX(p) (((uintptr_t)(p) >> SLAB_SHIFT) - ((uintptr_t)heap_lo >> SLAB_SHIFT))
+#define PAGE_OF(p) ((char *)((uintptr_t)(p) & ~(uintptr_t)(SLAB_SIZE - 1)))
+#define IS_SLAB(p) (slab_of(p) != NULL)
+#define SLAB_OF(p) slab_of(p)
+
+/* Mapped chunk macros. Build with -DMMAP_THRESHOLD=... to tune. */
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (1 << 18)      /* Smallest request mapped apart from the heap */
+#endif
+#define MAP_OFFSET ALIGN(sizeof(size_t)) /* Offset of the payload in its region */
+/* A pointer outside the MAX_HEAP bytes reserved for the heap is a mapped chunk */
+#define IS_MAPPED(p) ((uintptr_t)(p) - (uintptr_t)heap_lo >= MAX_HEAP)
+#define MAP_START(p) ((char *)(p) - MAP_OFFSET)
+#define MAP_LEN(p) (*(size_t *)MAP_START(p)) /* Length of the region, in whole pages */
+#define PAGE_ROUND(n) (((n) + mem_pagesize() - 1) & ~(mem_pagesize() - 1))
+
+/* A slab starts with this header and its slots fill the rest of the
+   payload of its heap block, SLAB_SIZE - WSIZE bytes */
+typedef struct slab
+{
+  struct slab *next, *prev;      /* Slabs of the class with free slots */
+  uint32_t class;                /* Index in slab_sizes */
+  uint32_t nfree;                /* Number of free slots */
+  uint64_t bitmap[SLAB_WORDS];   /* Bit i set when slot i is free */
+} slab_t;
+
+#define SLAB_FIRST ALIGN(sizeof(slab_t)) /* Offset of slot 0 in the slab */
+#define SLAB_SLOTS(class) ((SLAB_SIZE - WSIZE - SLAB_FIRST) / slab_sizes[class])
+
+/* Slot sizes of the slab classes */
+static const size_t slab_sizes[SLAB_CLASSES] = {8, 16, 24, 32, 48, 64, 96, 128};
+/* Class of the requests of 8 * i - 7 to 8 * i bytes */
+static const uint8_t slab_classes[SLAB_MAX / 8 + 1] = {0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7};
+
+/* Quick list macros. A freed block of up to QUICK_MAX bytes stays marked
+   allocated in a LIFO list of its size until consolidate runs.
+   Build with -DQUICK_MAX=0 to coalesce every free eagerly. */
+#ifndef QUICK_MAX
+#define QUICK_MAX 512                 /* Largest block kept in a quick list */
+#endif
+#define QUICK_LISTS (QUICK_MAX / ALIGNMENT + 1)
+#define QUICK_FRACTION 16             /* Consolidate once quick blocks hold 1/16 of the heap */
+#define QUICK_SHORTFALL 4             /* ... or 1/4 of what the heap would grow by */
+#define QUICK_NEXT(bp) (*(void **)(bp))
+
+/* mm_free_batch insertion sorts the batches of at most this many blocks */
+#define SORT_INSERT 32
+
+/* Region macros. A region hands out memory from chunks it takes with
+   mm_malloc, each starting with the link to the chunk taken before it. */
+#define REGION_CHUNK (1 << 16)          /* Default chunk size */
+#define REGION_LINK ALIGN(sizeof(void *)) /* Offset of the memory of a chunk */
+#define REGION_NEXT(chunk) (*(void **)(chunk))
 
-#define GET_NEXT_PTR(bp) (*(char **)(bp + WSIZE))
-#define GET_PREV_PTR(bp) (*(char **)(bp))
+/* Pool macros. A pool chunk is a heap block aligned to its own size, so
+   the chunk of an object is found by rounding the object down. */
+#define POOL_SHIFT 16
+#define POOL_CHUNK (1 << POOL_SHIFT)
+#define POOL_MAX (POOL_CHUNK / 8)       /* Largest object a pool holds */
+#define POOL_OF(p) ((pool_chunk_t *)((uintptr_t)(p) & ~(uintptr_t)(POOL_CHUNK - 1)))
 
-#define SET_NEXT_PTR(bp, qp) (GET_NEXT_PTR(bp) = qp)
-#define SET_PREV_PTR(bp, qp) (GET_PREV_PTR(bp) = qp)
+/* A pool chunk starts with this header and its objects fill the rest,
+   except for the last word which holds the header of the next heap block */
+typedef struct pool_chunk
+{
+  struct pool_chunk *next, *prev; /* Chunks of the same list of the pool */
+  void *free;                     /* Objects freed, linked through their first word */
+  char *unused;                   /* Objects past this one were never handed out */
+  uint32_t nfree;                 /* Objects free, freed or never handed out */
+} pool_chunk_t;
+
+/* The heap of an arena and everything indexing it. A THREADS build has up
+   to MAX_ARENAS of them, each in its own ARENA_SPAN bytes of the range
+   memlib reserves, so the arena of a block follows from its address. */
+typedef struct arena
+{
+  void *heap_listp;                /* Pointer to the prologue block */
+  char *heap_base;                 /* First heap byte, origin of the link offsets */
+  int id;                          /* Index in arenas, and arena number for memlib */
+  void *seg_lists[NUM_CLASSES];    /* Heads of the segregated free lists */
+#ifndef TLSF
+  void *tree_root;                 /* Root of the splay tree of large free blocks */
+  /* Size index: sizes and link offsets of indexed blocks, per class */
+  uint32_t index_size[NUM_CLASSES][INDEX_CAP] __attribute__((aligned(32)));
+  uint32_t index_off[NUM_CLASSES][INDEX_CAP] __attribute__((aligned(32)));
+  int index_count[NUM_CLASSES];    /* Number of indexed blocks */
+  int list_count[NUM_CLASSES];     /* Number of blocks in the list */
+#else
+  unsigned int fl_bitmap;           /* Bit f set if some list of range f is non-empty */
+  unsigned int sl_bitmap[FL_COUNT]; /* Bit s set if list (f, s) is non-empty */
+#endif
+  mm_stats_t stats;                /* Counters reported by mm_get_stats */
+  slab_t *slab_lists[SLAB_CLASSES];  /* Slabs with free slots, per class */
+  size_t slab_demand[SLAB_CLASSES]; /* Heap blocks marked allocated, by the slab class of their payload */
+  unsigned int slab_on;            /* Bit c set once class c is served from slabs */
+  size_t slab_map_len;             /* Entries of slab_map this arena may have set */
+  void *quick_lists[QUICK_LISTS];  /* Freed blocks not coalesced yet, by size */
+  size_t quick_bytes;              /* Bytes held in the quick lists */
+  void *wilderness;                /* Free block at the end of the heap, kept out of the lists */
+  size_t grow_chunk;               /* Current growth chunk of the heap */
+  unsigned long malloc_clock;      /* Requests that searched the free lists */
+  unsigned long last_grow;         /* Value of malloc_clock at the last heap growth */
+  size_t dirty_bytes;              /* Bytes freed since the last purge_heap */
+  uint32_t purge_epoch;            /* Number of purge_heap passes, plus one */
+  char *fresh;                     /* Wilderness payload from here on was never handed out */
+  char *zero_lo, *zero_hi;         /* Part of the block last placed that reads as zero */
+#ifdef THREADS
+  pthread_mutex_t lock;            /* Guards all of the above */
+  /* Blocks freed by threads of other arenas, drained under the lock */
+  void *remote __attribute__((aligned(64)));
+#endif
+} __attribute__((aligned(64))) arena_t;
+
+#ifdef THREADS
+/* Build with -DREMOTE_FREE=0 to have foreign frees take the arena lock */
+#ifndef REMOTE_FREE
+#define REMOTE_FREE 1
+#endif
 
-void *heap_listp = 0;
+/* Thread cache macros */
+#define CACHE_MAX QUICK_MAX           /* Largest block kept in a thread cache */
+#define CACHE_BINS (CACHE_MAX / ALIGNMENT + 1)
+#define CACHE_BYTES 4096              /* Half of the cache is flushed beyond this many bytes */
+#define CACHE_FILL 1024               /* Bytes a refill takes from the heap at most */
+#define CACHE_DEMAND 4                /* Misses of a bin before its refills take more blocks */
+
+/* Blocks owned by one thread, handed out and taken back without a lock */
+typedef struct
+{
+  void *bins[CACHE_BINS];           /* LIFO lists of blocks, by size / ALIGNMENT */
+  unsigned short count[CACHE_BINS]; /* Number of blocks in each bin */
+  unsigned char demand[CACHE_BINS]; /* Misses of each bin, halved at each flush */
+  size_t bytes;                     /* Bytes held in all the bins */
+  int filling;                      /* Set while a refill takes blocks from the heap */
+  unsigned long epoch;              /* Value of heap_epoch when the bins were filled */
+  arena_t *home;                    /* Arena the thread allocates from */
+} cache_t;
+#endif
+
+static arena_t arenas[MAX_ARENAS];
+static int arena_wanted = MAX_ARENAS; /* Arenas set up by the next mm_init */
+static int arena_count = 1;          /* Arenas set up by the last mm_init */
+static char *heap_lo;                /* First byte of the first arena */
+/* For each page, 1 plus the offset in ALIGNMENT units of the slab that
+   starts in it, or 0. A slab spans at most the next page too. */
+static uint16_t slab_map[SLAB_PAGES];
+#ifdef OOB_TAGS
+static uint32_t *meta_tags;          /* Headers and footers, one word per ALIGNMENT heap bytes */
+#endif
+#ifdef THREADS
+static unsigned int arena_next;        /* Arena given to the next new thread, modulo the count */
+static pthread_key_t cache_key;        /* Flushes the cache of an exiting thread */
+static unsigned long heap_epoch;       /* Number of mm_init calls, older caches are dropped */
+static __thread cache_t cache;         /* Cache of the calling thread */
+static __thread arena_t *arena;        /* Arena the calling thread works on */
+#define ARENA_OF(p) (IS_MAPPED(p) ? cache.home : &arenas[((char *)(p) - heap_lo) / ARENA_SPAN])
+#define LOCK() pthread_mutex_lock(&arena->lock)
+#define UNLOCK() pthread_mutex_unlock(&arena->lock)
+#else
+#define arena (&arenas[0])
+#endif
 /* Function Declarations */
 static void *coalesce(void *bp);
 static void *extend_heap(size_t words);
 static void *find_fit(size_t asize);
 static void place(void *bp, size_t asize);
+static void place_run(void *bp, size_t asize, size_t count, void **out);
+static void trim_block(void *bp, size_t asize);
 static int mm_check(void);
 
+static int size_class(size_t size);
+#ifdef TLSF
+static size_t search_size(size_t size);
+#else
+static void *splay(void *t, size_t size, void *addr);
+static void tree_insert(void *bp);
+static void tree_remove(void *bp);
+static void *tree_best_fit(size_t asize);
+static int index_find(const uint32_t *v, int n, uint32_t key, int exact);
+#endif
 static void insert_node(void *bp);
 static void delete_node(void *bp);
 
+static void *alloc_aligned(size_t asize, size_t align);
+static void *alloc_top(size_t asize);
+static int slab_class(size_t size);
+static int slab_wanted(size_t size, size_t n);
+static void slab_count(size_t bsize, int delta);
+static inline slab_t *slab_of(void *p);
+static void *slab_alloc(int class);
+static void slab_free(void *bp);
+static void consolidate(void);
+static int consolidate_before_grow(size_t shortfall);
+static void trim_heap(void);
+static void purge_heap(void);
+static void *map_alloc(size_t size);
+static int heap_init(void);
+static void *heap_alloc(size_t size);
+static void heap_free(void *bp);
+static void free_block(void *bp);
+static void quick_push(void *bp, size_t asize);
+static void *heap_realloc(void *ptr, size_t size);
+static void *heap_calloc(size_t size);
+static void *heap_memalign(size_t align, size_t size);
+static size_t heap_malloc_batch(size_t size, size_t n, void **out);
+static void heap_free_batch(void **ptrs, size_t n);
+static void sort_ptrs(void **ptrs, size_t n);
+static int ptr_cmp(const void *a, const void *b);
+static void *region_grow(mm_region_t *r, size_t size);
+static void pool_link(pool_chunk_t **list, pool_chunk_t *chunk);
+static void pool_unlink(pool_chunk_t **list, pool_chunk_t *chunk);
+#ifdef THREADS
+static void cache_reset(void);
+static size_t cache_size(void *bp);
+static void cache_put(void *bp, size_t size);
+static int cache_bin(size_t size);
+static void *cache_fill(int bin, size_t size);
+static void cache_flush(int bin, int keep);
+static int cache_release(void);
+static void cache_exit(void *arg);
+static void arena_free(void *bp);
+static void remote_drain(void);
+#endif
+
+/*
+ * mm_init - Creates an empty heap in each arena. In a THREADS build it
+ *     must not run while other threads use the allocator; the blocks left
+ *     in their caches belong to the old heaps and are dropped on their
+ *     next call, when they are also given an arena again.
+ */
 int mm_init(void)
 {
+  int ret = 0;
+
+  heap_lo = mem_heap_lo();
+#ifdef OOB_TAGS
+  /* One word per ALIGNMENT bytes of the whole reserved range, and one
+     more for the epilogue of a full heap */
+  if (meta_tags == NULL &&
+      (meta_tags = mem_map_table((MAX_HEAP / ALIGNMENT + 1) * sizeof(uint32_t))) == NULL)
+    return -1;
+#endif
+  arena_count = arena_wanted;
+#ifdef THREADS
+  if (heap_epoch++ == 0)
+  {
+    pthread_key_create(&cache_key, cache_exit);
+    for (arena = arenas; arena < arenas + MAX_ARENAS; arena++)
+      pthread_mutex_init(&arena->lock, NULL);
+  }
+  for (arena = arenas; arena < arenas + arena_count && ret == 0; arena++)
+  {
+    arena->id = arena - arenas;
+    LOCK();
+    ret = heap_init();
+    UNLOCK();
+  }
+#else
+  ret = heap_init();
+#endif
+  return ret;
+}
+
+/*
+ * mm_set_arenas - Sets the number of arenas created by the next mm_init,
+ *     at most MAX_ARENAS. Threads are given one of them in turn.
+ */
+void mm_set_arenas(int n)
+{
+  arena_wanted = MIN(MAX(n, 1), MAX_ARENAS);
+}
+
+static int heap_init(void)
+{
+  int class;
+
+  for (class = 0; class < NUM_CLASSES; class++)
+    arena->seg_lists[class] = NULL;
+#ifdef TLSF
+  arena->fl_bitmap = 0;
+  memset(arena->sl_bitmap, 0, sizeof(arena->sl_bitmap));
+#else
+  arena->tree_root = NULL;
+  memset(arena->index_count, 0, sizeof(arena->index_count));
+  memset(arena->list_count, 0, sizeof(arena->list_count));
+#endif
+  memset(&arena->stats, 0, sizeof(arena->stats));
+  for (class = 0; class < SLAB_CLASSES; class++)
+    arena->slab_lists[class] = NULL;
+  memset(arena->slab_demand, 0, sizeof(arena->slab_demand));
+  arena->slab_on = 0;
+  memset(slab_map, 0, arena->slab_map_len * sizeof(slab_map[0]));
+  arena->slab_map_len = 0;
+  memset(arena->quick_lists, 0, sizeof(arena->quick_lists));
+  arena->quick_bytes = 0;
+  arena->wilderness = NULL;
+  arena->grow_chunk = 0;
+  arena->malloc_clock = 0;
+  arena->last_grow = 0;
+  arena->dirty_bytes = 0;
+  arena->purge_epoch = 1; /* A stamp reading zero was never set by a pass */
+  arena->fresh = NULL;
+#ifdef THREADS
+  arena->remote = NULL;
+#endif
 
   /* Create the initial empty heap. */
-  if ((heap_listp = mem_sbrk(8 * WSIZE)) == NULL)
+  if ((arena->heap_listp = mem_arena_sbrk(arena->id, 4 * WSIZE)) == (void *)-1)
     return -1;
+  arena->heap_base = arena->heap_listp;
 
-  PUT(heap_listp, 0);                            /* Alignment padding */
-  PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1)); /* Prologue header */
-  PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1)); /* Prologue footer */
-  PUT(heap_listp + (3 * WSIZE), PACK(0, 1));     /* Epilogue header */
-  heap_listp += 2 * WSIZE;
+  PUT(arena->heap_listp, 0); /* Alignment padding */
+  arena->heap_listp += 2 * WSIZE;
+  PUT(FTRP(arena->heap_listp), PACK(DSIZE, ALLOC));                        /* Prologue footer */
+  PUT(HDRP(arena->heap_listp), PACK(DSIZE, ALLOC | PREV_ALLOC));           /* Prologue header */
+  PUT(HDRP(NEXT_BLK(arena->heap_listp)), PACK(0, ALLOC | PREV_ALLOC));     /* Epilogue header */
 
   /* Extend the empty heap with a free block of minimum possible block size */
   if (extend_heap(4) == NULL)
@@ -103,58 +503,153 @@ int mm_init(void)
 static void *extend_heap(size_t words)
 {
   char *bp;
+  void *merged;
   size_t size;
 
+  /* A count this large is a shortfall computed wrong, not a request */
+  if (words > MAX_HEAP / WSIZE)
+    return NULL;
+#ifdef THREADS
+  /* A cache refill only takes room the heap already has */
+  if (cache.filling)
+    return NULL;
+#endif
+
   /* Allocate an even number of words to maintain alignment */
   size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
-  //Since minimum block size given to us is 4 words (ie 16 bytes)
+  //A free block needs room for its header, links and footer
   if (size < MINBLOCKSIZE)
   {
     size = MINBLOCKSIZE;
   }
-  /* call for more memory space */
-  if ((int)(bp = mem_sbrk(size)) == -1)
+  /* call for more memory space. Memlib may hand back pages it kept
+     committed since an earlier shrink, which are not zero any more. */
+  arena->fresh = MAX(arena->fresh, (char *)mem_arena_fresh(arena->id));
+  if ((bp = mem_arena_sbrk(arena->id, size)) == (void *)-1)
   {
     return NULL;
   }
-  /* Initialize free block header/footer and the epilogue header */
-  PUT(HDRP(bp), PACK(size, 0));        /* free block header */
-  PUT(FTRP(bp), PACK(size, 0));        /* free block footer */
-  PUT(HDRP(NEXT_BLK(bp)), PACK(0, 1)); /* new epilogue header */
-  /* coalesce bp with next and previous blocks */
-  return coalesce(bp);
+  /* Initialize free block header/footer and the epilogue header.
+     The old epilogue header becomes the new block header and keeps
+     its previous-allocated bit. */
+  PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)))); /* free block header */
+  PUT(FTRP(bp), PACK(size, 0));                        /* free block footer */
+  PUT(HDRP(NEXT_BLK(bp)), PACK(0, ALLOC));             /* new epilogue header */
+  /* coalesce bp with next and previous blocks. When it joins the old
+     wilderness, its footer and the old epilogue end up inside the new
+     one and are cleared so that it stays zero past arena->fresh. */
+  if ((merged = coalesce(bp)) != bp)
+  {
+    PUT(PREV_FTRP(bp), 0);
+    PUT(HDRP(bp), 0);
+  }
+  return merged;
+}
+
+/*
+ * mm_malloc - In a THREADS build, requests of up to CACHE_MAX bytes are
+ *     served from the cache of the calling thread without taking the
+ *     lock, which is only held to refill an empty bin.
+ */
+void *mm_malloc(size_t size)
+{
+#ifdef THREADS
+  int bin = cache_bin(size);
+  void *bp;
+
+  if (cache.epoch != heap_epoch)
+    cache_reset();
+  if (bin > 0 && (bp = cache.bins[bin]) != NULL)
+  {
+    cache.bins[bin] = QUICK_NEXT(bp);
+    cache.count[bin]--;
+    cache.bytes -= bin * ALIGNMENT;
+    return bp;
+  }
+  arena = cache.home;
+  LOCK();
+  remote_drain();
+  bp = bin > 0 ? cache_fill(bin, size) : heap_alloc(size);
+  UNLOCK();
+  return bp;
+#else
+  return heap_alloc(size);
+#endif
 }
 
 /* 
- * mm_malloc - Allocate a block by incrementing the brk pointer.
+ * heap_alloc - Allocate a block by incrementing the brk pointer.
  *     Always allocate a block whose size is a multiple of the alignment.
  */
-
-void *mm_malloc(size_t size)
+static void *heap_alloc(size_t size)
 {
   size_t asize;      /* Adjusted block size */
   size_t extendsize; /* Amount to extend heap if no fit */
   void *bp;
 
   /* Ignore spurious requests. */
-  if (size == 0)
+  if (size == 0 || size > MAXBLOCKSIZE - DSIZE)
     return (NULL);
 
-  /* Adjust block size to include overhead and alignment reqs. */
-  if (size <= DSIZE)
-    asize = 2 * DSIZE;
-  else
-    asize = DSIZE * ((size + DSIZE + (DSIZE - 1)) / DSIZE);
+  /* Small requests go to a slab slot, huge ones to a region of their own */
+  if (size <= SLAB_MAX && slab_wanted(size, 1))
+    return slab_alloc(slab_class(size));
+  if (size >= MMAP_THRESHOLD)
+    return map_alloc(size);
+
+  /* Adjust block size to include the header and alignment reqs. */
+  asize = MAX(ALIGN(size + WSIZE), MINBLOCKSIZE);
+
+  /* A block of this size freed recently is reused as it is */
+  if (asize <= QUICK_MAX && (bp = arena->quick_lists[asize / ALIGNMENT]) != NULL)
+  {
+    arena->quick_lists[asize / ALIGNMENT] = QUICK_NEXT(bp);
+    arena->quick_bytes -= asize;
+    PUT(HDRP(bp), GET(HDRP(bp)) & ~GROWN);
+    return (bp);
+  }
 
   /* Search the free list for a fit. */
+  arena->malloc_clock++;
   if ((bp = find_fit(asize)) != NULL)
   {
     place(bp, asize);
     return (bp);
   }
 
-  /* No fit found.  Get more memory and place the block. */
-  extendsize = MAX(asize, CHUNKSIZE);
+  /* The wilderness is used last, so it stays as large as possible */
+  if (arena->wilderness != NULL && GET_SIZE(HDRP(arena->wilderness)) >= asize)
+  {
+    bp = arena->wilderness;
+    place(bp, asize);
+    return (bp);
+  }
+
+  /* Merge the quick blocks, however few, with their neighbours before
+     growing the heap. Those next to the wilderness merge into it, which
+     may then fit. */
+  if (consolidate_before_grow(0))
+  {
+    if ((bp = find_fit(asize)) == NULL && arena->wilderness != NULL &&
+        GET_SIZE(HDRP(arena->wilderness)) >= asize)
+      bp = arena->wilderness;
+    if (bp != NULL)
+    {
+      place(bp, asize);
+      return (bp);
+    }
+  }
+
+  /* No fit found.  Grow the wilderness by the shortfall, or by the growth
+     chunk if that is larger. The chunk doubles while the heap keeps growing
+     within GROW_WINDOW requests and halves when growth slows down. */
+  if (arena->malloc_clock - arena->last_grow <= GROW_WINDOW)
+    arena->grow_chunk = MIN(MAX(2 * arena->grow_chunk, GROW_MIN), GROW_MAX);
+  else
+    arena->grow_chunk /= 2;
+  arena->last_grow = arena->malloc_clock;
+  extendsize = asize - (arena->wilderness != NULL ? GET_SIZE(HDRP(arena->wilderness)) : 0);
+  extendsize = MAX(extendsize, MIN(arena->grow_chunk, mem_arena_size(arena->id) / 8));
   if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
     return (NULL);
   place(bp, asize);
@@ -165,7 +660,7 @@ static void *coalesce(void *bp)
 {
 
   size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLK(bp)));
-  size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLK(bp))) || PREV_BLK(bp) == bp;
+  size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
   size_t size = GET_SIZE(HDRP(bp));
 
   if (prev_alloc && !next_alloc)
@@ -173,7 +668,7 @@ static void *coalesce(void *bp)
     //merge with existing
     size += GET_SIZE(HDRP(NEXT_BLK(bp)));
     delete_node(NEXT_BLK(bp));
-    PUT(HDRP(bp), PACK(size, 0));
+    PUT(HDRP(bp), PACK(size, PREV_ALLOC));
     PUT(FTRP(bp), PACK(size, 0));
   }
 
@@ -182,7 +677,7 @@ static void *coalesce(void *bp)
     size += GET_SIZE(HDRP(PREV_BLK(bp)));
     bp = PREV_BLK(bp);
     delete_node(bp);
-    PUT(HDRP(bp), PACK(size, 0));
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
     PUT(FTRP(bp), PACK(size, 0));
   }
 
@@ -192,196 +687,2050 @@ static void *coalesce(void *bp)
     delete_node(PREV_BLK(bp));
     delete_node(NEXT_BLK(bp));
     bp = PREV_BLK(bp);
-    PUT(HDRP(bp), PACK(size, 0));
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
     PUT(FTRP(bp), PACK(size, 0));
   }
+  /* The block after a free block always sees a free predecessor */
+  CLEAR_PREV_ALLOC(HDRP(NEXT_BLK(bp)));
   insert_node(bp);
   return bp;
 }
 
 /*
- * mm_free - Freeing a block does nothing.
+ * mm_free - In a THREADS build, blocks of up to CACHE_MAX bytes go to the
+ *     cache of the calling thread, whichever thread allocated them. Half
+ *     of a bin goes back to the heap, under the lock, once it is full.
  */
 void mm_free(void *bp)
 {
-  size_t size;
+#ifdef THREADS
   if (bp == NULL)
     return;
-  size = GET_SIZE(HDRP(bp));
-  PUT(HDRP(bp), PACK(size, 0));
-  PUT(FTRP(bp), PACK(size, 0));
-  coalesce(bp);
+  if (cache.epoch != heap_epoch)
+    cache_reset();
+  cache_put(bp, cache_size(bp));
+#else
+  heap_free(bp);
+#endif
 }
 
 /*
- if ptr is NULL, the call is equivalent to mm_malloc(size);
-if size is equal to zero, the call is equivalent to mm_free(ptr);
-if ptr is not NULL, it must have been returned by an earlier call to mm_malloc or mm_realloc. 
-The call to mm_realloc changes the size of the memory block pointed to by ptr (the old block) 
-to size bytes and returns the address of the new block. 
-Notice that the address of the new block might be the same as the old block, 
-or it might be different, depending on your implementation, the amount of internal fragmentation in the old block, 
-and the size of the resalloc request.
-The contents of the new block are the same as those of the old ptr block, 
-up to the minimum of the old and new sizes. Everything else is uninitialized. 
-For example, if the old block is 8 bytes and the new block is 12 bytes, 
-then the first 8 bytes of the new block are identical to the first 8 bytes of the old block and the last 4 bytes are uninitialized. 
-Similarly, if the old block is 8 bytes and the new block is 4 bytes, then the contents of the new block are identical to the first 4 bytes of the old block.
-*/
-void *mm_realloc(void *ptr, size_t size)
+ * mm_free_sized - mm_free for a caller that knows the size it asked for,
+ *     or any size up to mm_usable_size. The size picks the quick list, or
+ *     the cache bin in a THREADS build, without reading the header, and a
+ *     block of more than SLAB_MAX bytes is not looked up in slab_map.
+ *     Blocks too large for a quick list still read their header, and so do
+ *     small heap blocks in a THREADS build.
+ */
+void mm_free_sized(void *bp, size_t size)
 {
-  if (ptr == NULL)
+  if (bp == NULL)
+    return;
+#ifdef THREADS
+  if (cache.epoch != heap_epoch)
+    cache_reset();
+  if (IS_MAPPED(bp))
+    arena_free(bp);
+  else if (size > SLAB_MAX)
+    cache_put(bp, cache_bin(size) * ALIGNMENT);
+  else if (IS_SLAB(bp))
+    cache_put(bp, slab_sizes[slab_class(size)]);
+  else
+    cache_put(bp, cache_size(bp));
+#else
+  if (IS_MAPPED(bp))
+    heap_free(bp);
+  else if (size <= SLAB_MAX && IS_SLAB(bp))
+    slab_free(bp);
+  else if ((size = MAX(ALIGN(size + WSIZE), MINBLOCKSIZE)) <= QUICK_MAX)
+    quick_push(bp, size);
+  else
+    free_block(bp);
+#endif
+}
+
+/*
+ * mm_usable_size - Returns how many bytes the block at bp holds, which
+ *     may be more than were asked for, or 0 for NULL
+ */
+size_t mm_usable_size(void *bp)
+{
+  if (bp == NULL)
+    return 0;
+  if (IS_MAPPED(bp))
+    return MAP_LEN(bp) - MAP_OFFSET;
+  if (IS_SLAB(bp))
+    return slab_sizes[SLAB_OF(bp)->class];
+  return GET_SIZE(HDRP(bp)) - WSIZE;
+}
+
+/*
+ * mm_malloc_at_least - mm_malloc that also stores in *usable the number
+ *     of bytes the block holds, all of which the caller may use
+ */
+void *mm_malloc_at_least(size_t size, size_t *usable)
+{
+  void *bp = mm_malloc(size);
+
+  *usable = mm_usable_size(bp);
+  return bp;
+}
+
+/*
+ * A region lives at the start of its first chunk, which it keeps until it
+ * is destroyed. The memory between cur and end is still free.
+ */
+struct mm_region
+{
+  char *cur, *end;   /* Free part of the chunk allocations are cut from */
+  void *chunks;      /* Chunks taken after the first one, latest first */
+  size_t chunk_size; /* Size of a chunk */
+  size_t first_size; /* Usable size of the first chunk */
+};
+
+/*
+ * mm_region_create - Creates an empty region whose chunks hold chunk_size
+ *     bytes, or REGION_CHUNK if it is 0. Returns NULL if memory runs out.
+ *     A region must not be used by two threads at once.
+ */
+mm_region_t *mm_region_create(size_t chunk_size)
+{
+  mm_region_t *r;
+  size_t usable;
+
+  if (chunk_size == 0)
+    chunk_size = REGION_CHUNK;
+  chunk_size = MAX(chunk_size, ALIGN(sizeof(mm_region_t)) + REGION_LINK);
+  if ((r = mm_malloc_at_least(chunk_size, &usable)) == NULL)
+    return NULL;
+  r->chunks = NULL;
+  r->chunk_size = chunk_size;
+  r->first_size = usable;
+  mm_region_reset(r);
+  return r;
+}
+
+/*
+ * mm_region_alloc - Allocates size bytes from the region by moving its
+ *     pointer. The memory is only given back by mm_region_reset or
+ *     mm_region_destroy.
+ */
+void *mm_region_alloc(mm_region_t *r, size_t size)
+{
+  char *bp = r->cur;
+
+  if (size == 0 || size > MAXBLOCKSIZE)
+    return NULL;
+  size = ALIGN(size);
+  if (size <= (size_t)(r->end - bp))
   {
-    return mm_malloc(size);
+    r->cur = bp + size;
+    return bp;
   }
-  if (size == 0)
+  return region_grow(r, size);
+}
+
+/*
+ * mm_region_reset - Frees everything allocated from the region at once.
+ *     The chunks go back to the heap, where neighbouring ones coalesce into
+ *     large free blocks, but for the first one, which the region reuses.
+ */
+void mm_region_reset(mm_region_t *r)
+{
+  void *chunk, *next;
+
+  for (chunk = r->chunks; chunk != NULL; chunk = next)
   {
-    mm_free(ptr);
-    return NULL;
+    next = REGION_NEXT(chunk);
+    mm_free(chunk);
   }
+  r->chunks = NULL;
+  r->cur = (char *)r + ALIGN(sizeof(mm_region_t));
+  r->end = (char *)r + r->first_size;
+}
 
-  //ptr is not null
-  size_t current_size = GET_SIZE(HDRP(ptr));
-  size_t sizeBis = MAX(ALIGN(size) + DSIZE, MINBLOCKSIZE);
-  void *bp;
+/*
+ * mm_region_destroy - Frees everything allocated from the region, and the
+ *     region itself
+ */
+void mm_region_destroy(mm_region_t *r)
+{
+  if (r == NULL)
+    return;
+  mm_region_reset(r);
+  mm_free(r);
+}
+
+/*
+ * region_grow - Allocates size bytes from a new chunk of the region.
+ *     A request of more than a quarter of a chunk gets a chunk of its own,
+ *     so that the rest of the current chunk is not wasted.
+ */
+static void *region_grow(mm_region_t *r, size_t size)
+{
+  size_t usable;
+  char *chunk;
 
-  if (sizeBis == current_size)
+  if (size > r->chunk_size / 4)
   {
-    return ptr;
+    if ((chunk = mm_malloc(REGION_LINK + size)) == NULL)
+      return NULL;
+    REGION_NEXT(chunk) = r->chunks;
+    r->chunks = chunk;
+    return chunk + REGION_LINK;
   }
+  if ((chunk = mm_malloc_at_least(r->chunk_size, &usable)) == NULL)
+    return NULL;
+  REGION_NEXT(chunk) = r->chunks;
+  r->chunks = chunk;
+  r->cur = chunk + REGION_LINK + size;
+  r->end = chunk + usable;
+  return chunk + REGION_LINK;
+}
 
-  bp = mm_malloc(sizeBis);
-  memcpy(bp, ptr, sizeBis);
-  mm_free(ptr);
-  return bp;
+/*
+ * A pool cuts objects of one size from chunks of POOL_CHUNK bytes. The
+ * chunks with free objects are kept in one list and the full ones in
+ * another. Each chunk keeps its freed objects in a list linked through
+ * their first word, and hands out the objects it never gave before by
+ * moving a pointer, so a new chunk costs no pass over its objects.
+ */
+struct mm_pool
+{
+  pool_chunk_t *partial; /* Chunks with free objects */
+  pool_chunk_t *full;    /* Chunks without */
+  size_t size;           /* Object size, a multiple of the alignment */
+  size_t first;          /* Offset of the first object in a chunk */
+  uint32_t slots;        /* Objects in a chunk */
+};
+
+/*
+ * mm_pool_create - Creates an empty pool of objects of size bytes aligned
+ *     to align bytes, or ALIGNMENT if it is 0. Returns NULL if the
+ *     alignment is not a power of two, if size is 0 or more than POOL_MAX,
+ *     or if memory runs out. A pool must not be used by two threads at once.
+ */
+mm_pool_t *mm_pool_create(size_t size, size_t align)
+{
+  mm_pool_t *pool;
+
+  if (align == 0)
+    align = ALIGNMENT;
+  if ((align & (align - 1)) != 0 || size == 0 || size > POOL_MAX || align > POOL_MAX)
+    return NULL;
+  align = MAX(align, sizeof(void *));
+  if ((pool = mm_malloc(sizeof(mm_pool_t))) == NULL)
+    return NULL;
+  pool->partial = pool->full = NULL;
+  pool->size = ALIGN_UP(MAX(size, sizeof(void *)), align);
+  pool->first = ALIGN_UP(sizeof(pool_chunk_t), align);
+  pool->slots = (POOL_CHUNK - WSIZE - pool->first) / pool->size;
+  return pool;
 }
 
- /*  Finds fit for a block with "asize" bytes from the free list.
- *   Extends the heap if there is a remainder.
- *   And Returns that block's address
- *   or NULL if no suitable block was found. 
+/*
+ * mm_pool_alloc - Takes an object from the pool, taking a new chunk from
+ *     the heap if every chunk is full
  */
-static void *find_fit(size_t asize)
+void *mm_pool_alloc(mm_pool_t *pool)
 {
+  pool_chunk_t *chunk = pool->partial;
   void *bp;
-  static int malloc_size = 0;
-  static int counter = 0;
-  if (malloc_size == (int)asize)
+
+  if (chunk == NULL)
   {
-    if (counter > 30)
-    {
-      int sizeBis = MAX(asize, MINBLOCKSIZE);
-      bp = extend_heap(sizeBis / 4);
-      return bp;
-    }
-    else
-      counter++;
+    /* One word less than a chunk makes a block of exactly POOL_CHUNK
+       bytes, so chunks taken one after the other end up next to each
+       other */
+    if ((chunk = mm_memalign(POOL_CHUNK, POOL_CHUNK - WSIZE)) == NULL)
+      return NULL;
+    chunk->free = NULL;
+    chunk->unused = (char *)chunk + pool->first;
+    chunk->nfree = pool->slots;
+    pool_link(&pool->partial, chunk);
   }
+
+  if ((bp = chunk->free) != NULL)
+    chunk->free = *(void **)bp;
   else
-    counter = 0;
-  
-  for (bp = heap_listp; GET_ALLOC(HDRP(bp)) == 0; bp = GET_NEXT_PTR(bp))
   {
-    if (asize <= (size_t)GET_SIZE(FTRP(bp)))
-    {
-      malloc_size = asize;
-      return bp;
-    }
+    bp = chunk->unused;
+    chunk->unused += pool->size;
   }
-  return NULL;
+
+  /* A full chunk moves to the full list */
+  if (--chunk->nfree == 0)
+  {
+    pool_unlink(&pool->partial, chunk);
+    pool_link(&pool->full, chunk);
+  }
+  return bp;
 }
 
-/*   Place a block of "asize" bytes at the start of the free block "bp" and
- *   split that block if the remainder would be at least the minimum block
- *   size. 
+/*
+ * mm_pool_free - Gives an object back to its pool. A chunk left without
+ *     objects goes back to the heap unless it is the only one of the pool
+ *     with free objects.
  */
-static void place(void *bp, size_t asize)
+void mm_pool_free(mm_pool_t *pool, void *ptr)
 {
-  size_t freeSize = GET_SIZE(HDRP(bp));
+  pool_chunk_t *chunk;
 
-  if ((freeSize - asize) >= MINBLOCKSIZE)
+  if (ptr == NULL)
+    return;
+  chunk = POOL_OF(ptr);
+  *(void **)ptr = chunk->free;
+  chunk->free = ptr;
+  if (chunk->nfree++ == 0)
   {
-    PUT(HDRP(bp), PACK(asize, 1));
-    PUT(FTRP(bp), PACK(asize, 1));
-    delete_node(bp);
-    bp = NEXT_BLK(bp);
-    PUT(HDRP(bp), PACK(freeSize - asize, 0));
-    PUT(FTRP(bp), PACK(freeSize - asize, 0));
-    coalesce(bp);
+    /* It was full, put it back in the partial list */
+    pool_unlink(&pool->full, chunk);
+    pool_link(&pool->partial, chunk);
   }
-  else
+  else if (chunk->nfree == pool->slots &&
+           (chunk->prev != NULL || chunk->next != NULL))
   {
-    PUT(HDRP(bp), PACK(freeSize, 1));
-    PUT(FTRP(bp), PACK(freeSize, 1));
-    delete_node(bp);
+    pool_unlink(&pool->partial, chunk);
+    mm_free(chunk);
   }
 }
 
+/*
+ * mm_pool_destroy - Gives back every chunk of the pool, and the pool
+ *     itself, whether or not its objects were freed
+ */
+void mm_pool_destroy(mm_pool_t *pool)
+{
+  pool_chunk_t *chunk, *next;
 
+  if (pool == NULL)
+    return;
+  for (chunk = pool->partial; chunk != NULL; chunk = next)
+  {
+    next = chunk->next;
+    mm_free(chunk);
+  }
+  for (chunk = pool->full; chunk != NULL; chunk = next)
+  {
+    next = chunk->next;
+    mm_free(chunk);
+  }
+  mm_free(pool);
+}
 
-/*Inserts and deletes the free block pointer int the free_list*/
-
-static void insert_node(void *bp)
+/* Pushes a chunk on a list of its pool */
+static void pool_link(pool_chunk_t **list, pool_chunk_t *chunk)
 {
-  SET_NEXT_PTR(bp, heap_listp);
-  SET_PREV_PTR(heap_listp, bp);
-  SET_PREV_PTR(bp, NULL);
-  heap_listp = bp;
+  chunk->prev = NULL;
+  chunk->next = *list;
+  if (chunk->next != NULL)
+    chunk->next->prev = chunk;
+  *list = chunk;
 }
 
-static void delete_node(void *bp)
+/* Takes a chunk out of a list of its pool */
+static void pool_unlink(pool_chunk_t **list, pool_chunk_t *chunk)
 {
-  if (GET_PREV_PTR(bp))
-    SET_NEXT_PTR(GET_PREV_PTR(bp), GET_NEXT_PTR(bp));
+  if (chunk->prev != NULL)
+    chunk->prev->next = chunk->next;
   else
-    heap_listp = GET_NEXT_PTR(bp);
-  SET_PREV_PTR(GET_NEXT_PTR(bp), GET_PREV_PTR(bp));
+    *list = chunk->next;
+  if (chunk->next != NULL)
+    chunk->next->prev = chunk->prev;
 }
 
-static int mm_check(void)
+/*
+ * heap_free - Unmaps a mapped region, or hands a slot back to its slab
+ *     and any other block to free_block
+ */
+static void heap_free(void *bp)
 {
-
-  void *bp;
-  // Only free block inside free list and next are valid
-  for (bp = heap_listp; GET_ALLOC(HDRP(bp)) == 0; bp = GET_NEXT_PTR(bp))
+  if (bp == NULL)
+    return;
+  if (IS_MAPPED(bp))
   {
+    mem_unmap(MAP_START(bp));
+    return;
   }
-  printf("End of heap : %p \n",bp);
-
-  //Check Coalesce
-  for (bp = heap_listp; GET_ALLOC(HDRP(bp)) == 0; bp = GET_NEXT_PTR(bp))
+  if (IS_SLAB(bp))
   {
-
-    if (GET_NEXT_PTR(bp) == NEXT_BLK(bp) || GET_PREV_PTR(bp) == PREV_BLK(bp))
-    {
-      return 1;
-    }
+    slab_free(bp);
+    return;
   }
+  free_block(bp);
+}
 
-  //is every free block in the free list
+/*
+ * free_block - Small blocks go to the quick list of their size and stay
+ *     marked allocated, so nothing coalesces with them until the next
+ *     consolidation. Other blocks are coalesced right away.
+ */
+static void free_block(void *bp)
+{
+  size_t size = GET_SIZE(HDRP(bp));
 
-  void *p;
-  bool found = false;
-  for (bp = heap_listp; bp != NULL; bp = NEXT_BLK(bp))
+  if (size <= QUICK_MAX)
   {
-    if (GET_ALLOC(HDRP(bp)) == 0)
-    {
-      found = false;
-      for (p = heap_listp; GET_ALLOC(HDRP(p)) == 0; p = GET_NEXT_PTR(p))
-      {
-        if (p == bp)
-        {
-          found = true;
-          break;
-        }
-      }
-      if (!found){
-        return 1;
-      }
-    }
+    quick_push(bp, size);
+    return;
   }
+  slab_count(size, -1);
+  PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+  PUT(FTRP(bp), PACK(size, 0));
+  coalesce(bp);
+  trim_heap();
+  arena->dirty_bytes += size;
+  if (PURGE_DUE())
+    purge_heap();
+}
 
+/* Pushes bp on the quick list of blocks of asize bytes, which may be less
+   than its size. The header is neither read nor written: the block stays
+   marked allocated, and the GROWN bit is cleared when it is taken again. */
+static void quick_push(void *bp, size_t asize)
+{
+  QUICK_NEXT(bp) = arena->quick_lists[asize / ALIGNMENT];
+  arena->quick_lists[asize / ALIGNMENT] = bp;
+  arena->quick_bytes += asize;
+  if (arena->quick_bytes > mem_arena_size(arena->id) / QUICK_FRACTION)
+    consolidate();
+}
 
-
-
+/*
+ if ptr is NULL, the call is equivalent to mm_malloc(size);
+if size is equal to zero, the call is equivalent to mm_free(ptr);
+if ptr is not NULL, it must have been returned by an earlier call to mm_malloc or mm_realloc. 
+The call to mm_realloc changes the size of the memory block pointed to by ptr (the old block) 
+to size bytes and returns the address of the new block. 
+Notice that the address of the new block might be the same as the old block, 
+or it might be different, depending on your implementation, the amount of internal fragmentation in the old block, 
+and the size of the resalloc request.
+The contents of the new block are the same as those of the old ptr block, 
+up to the minimum of the old and new sizes. Everything else is uninitialized. 
+For example, if the old block is 8 bytes and the new block is 12 bytes, 
+then the first 8 bytes of the new block are identical to the first 8 bytes of the old block and the last 4 bytes are uninitialized. 
+Similarly, if the old block is 8 bytes and the new block is 4 bytes, then the contents of the new block are identical to the first 4 bytes of the old block.
+*/
+void *mm_realloc(void *ptr, size_t size)
+{
+#ifdef THREADS
+  void *bp;
+
+  if (ptr == NULL)
+    return mm_malloc(size);
+  if (cache.epoch != heap_epoch)
+    cache_reset();
+  arena = ARENA_OF(ptr);
+  LOCK();
+  bp = heap_realloc(ptr, size);
+  UNLOCK();
+  return bp;
+#else
+  return heap_realloc(ptr, size);
+#endif
+}
+
+/*
+ * heap_realloc - Resizes in place when it can: a shrink frees the tail and
+ *     a grow takes the next block if it is free, or grows the heap when the
+ *     block is last. A block that grows again right after a grow gets
+ *     RESERVE room, from the free lists or else at the top of the heap.
+ */
+static void *heap_realloc(void *ptr, size_t size)
+{
+  if (ptr == NULL)
+  {
+    return heap_alloc(size);
+  }
+  if (size == 0)
+  {
+    heap_free(ptr);
+    return NULL;
+  }
+
+  //ptr is a mapped chunk: remap it while it stays huge, which copies nothing
+  if (IS_MAPPED(ptr))
+  {
+    size_t len = PAGE_ROUND(size + MAP_OFFSET);
+    void *bp;
+
+    if (size >= MMAP_THRESHOLD)
+    {
+      if (len != MAP_LEN(ptr))
+      {
+        if ((bp = mem_remap(MAP_START(ptr), len)) == NULL)
+          return NULL;
+        ptr = (char *)bp + MAP_OFFSET;
+        MAP_LEN(ptr) = len;
+      }
+      arena->stats.realloc_inplace++;
+      return ptr;
+    }
+    if ((bp = heap_alloc(size)) == NULL)
+      return NULL;
+    memcpy(bp, ptr, size);
+    arena->stats.realloc_moves++;
+    arena->stats.copy_bytes += size;
+    mem_unmap(MAP_START(ptr));
+    return bp;
+  }
+
+  //ptr is a slab slot: keep it if the size class does not change
+  if (IS_SLAB(ptr))
+  {
+    size_t slot = slab_sizes[SLAB_OF(ptr)->class];
+    void *bp;
+
+    if (size <= SLAB_MAX && slab_class(size) == (int)SLAB_OF(ptr)->class)
+    {
+      arena->stats.realloc_inplace++;
+      return ptr;
+    }
+    if ((bp = heap_alloc(size)) == NULL)
+      return NULL;
+    memcpy(bp, ptr, MIN(slot, size));
+    arena->stats.realloc_moves++;
+    arena->stats.copy_bytes += MIN(slot, size);
+    heap_free(ptr);
+    return bp;
+  }
+
+  //ptr is not null
+  if (size > MAXBLOCKSIZE - DSIZE)
+    return NULL;
+  size_t current_size = GET_SIZE(HDRP(ptr));
+  size_t sizeBis = MAX(ALIGN(size + WSIZE), MINBLOCKSIZE);
+  //A block that keeps growing is likely to grow again: give it headroom
+  size_t reserve = GET(HDRP(ptr)) & GROWN ? RESERVE(sizeBis) : sizeBis;
+  void *next = NEXT_BLK(ptr);
+  size_t avail = current_size;
+  void *bp;
+
+  //Shrink in place, the tail goes back to the free lists and the block no
+  //longer counts as growing
+  if (sizeBis <= current_size)
+  {
+    PUT(HDRP(ptr), GET(HDRP(ptr)) & ~GROWN);
+    trim_block(ptr, sizeBis);
+    slab_count(current_size, -1);
+    slab_count(GET_SIZE(HDRP(ptr)), 1);
+    arena->stats.realloc_inplace++;
+    return ptr;
+  }
+
+  //Grow in place: the block is followed by free space, possibly at the top
+  if (!GET_ALLOC(HDRP(next)))
+  {
+    avail += GET_SIZE(HDRP(next));
+    next = NEXT_BLK(next);
+  }
+  if (avail < sizeBis && GET_SIZE(HDRP(next)) == 0 &&
+      consolidate_before_grow(sizeBis - avail))
+  {
+    //Merging the quick blocks may have freed the block that follows
+    next = NEXT_BLK(ptr);
+    avail = current_size;
+    if (!GET_ALLOC(HDRP(next)))
+    {
+      avail += GET_SIZE(HDRP(next));
+      next = NEXT_BLK(next);
+    }
+  }
+  if (avail < sizeBis && GET_SIZE(HDRP(next)) == 0)
+  {
+    //Only the epilogue follows: the heap grows by the shortfall, later
+    //growth will be in place again so no headroom is needed
+    if (extend_heap((sizeBis - avail) / WSIZE) == NULL)
+      return NULL;
+    avail = sizeBis;
+  }
+  if (avail >= sizeBis)
+  {
+    next = NEXT_BLK(ptr);
+    avail = current_size + GET_SIZE(HDRP(next));
+    delete_node(next);
+    PUT(HDRP(ptr), PACK(avail, GET_FLAGS(HDRP(ptr)) | GROWN));
+    SET_PREV_ALLOC(HDRP(NEXT_BLK(ptr)));
+    trim_block(ptr, sizeBis);
+    slab_count(current_size, -1);
+    slab_count(GET_SIZE(HDRP(ptr)), 1);
+    arena->fresh = MAX(arena->fresh, (char *)NEXT_BLK(ptr));
+    arena->stats.realloc_inplace++;
+    return ptr;
+  }
+
+  //Move, copying only the old payload. A block with headroom takes a free
+  //block that fits it, or else the end of the heap where it can keep growing.
+  if (reserve > sizeBis && size < MMAP_THRESHOLD)
+  {
+    if ((bp = find_fit(reserve)) != NULL)
+      place(bp, reserve);
+    else
+      bp = alloc_top(reserve);
+  }
+  else
+    bp = heap_alloc(size);
+  if (bp == NULL)
+    return NULL;
+  if (!IS_MAPPED(bp) && !IS_SLAB(bp))
+    PUT(HDRP(bp), GET(HDRP(bp)) | GROWN);
+  memcpy(bp, ptr, MIN(current_size - WSIZE, size));
+  arena->stats.realloc_moves++;
+  arena->stats.copy_bytes += MIN(current_size - WSIZE, size);
+  heap_free(ptr);
+  return bp;
+}
+
+/*
+ * mm_calloc - Allocates zeroed room for nmemb elements of size bytes,
+ *     or returns NULL if that many bytes overflow a size_t. Only the part
+ *     of the block that may hold old data is cleared.
+ */
+void *mm_calloc(size_t nmemb, size_t size)
+{
+  size_t bytes;
+#ifdef THREADS
+  void *bp;
+#endif
+
+  if (__builtin_mul_overflow(nmemb, size, &bytes))
+    return NULL;
+#ifdef THREADS
+  /* Cached blocks have been used before */
+  if (cache_bin(bytes) > 0)
+  {
+    if ((bp = mm_malloc(bytes)) != NULL)
+      memset(bp, 0, bytes);
+    return bp;
+  }
+  if (cache.epoch != heap_epoch)
+    cache_reset();
+  arena = cache.home;
+  LOCK();
+  remote_drain();
+  bp = heap_calloc(bytes);
+  UNLOCK();
+  return bp;
+#else
+  return heap_calloc(bytes);
+#endif
+}
+
+/*
+ * heap_calloc - Mapped regions come zeroed from the system. A heap block
+ *     is zeroed but for the range place found still clean: the part of
+ *     the wilderness no block ever used, or pages purge_heap gave back.
+ */
+static void *heap_calloc(size_t size)
+{
+  char *bp, *lo, *hi;
+
+  arena->zero_lo = arena->zero_hi = NULL;
+  if ((bp = heap_alloc(size)) == NULL || IS_MAPPED(bp))
+    return bp;
+  lo = MAX(arena->zero_lo, bp);
+  hi = MIN(arena->zero_hi, bp + size);
+  if (size <= SLAB_MAX || lo >= hi)
+  {
+    memset(bp, 0, size);
+    return bp;
+  }
+  memset(bp, 0, lo - bp);
+  memset(hi, 0, bp + size - hi);
+  return bp;
+}
+
+/*
+ * mm_memalign - Allocates size bytes whose address is a multiple of
+ *     align, a power of two, or returns NULL if align is not one. The
+ *     block is freed and resized like any other.
+ */
+void *mm_memalign(size_t align, size_t size)
+{
+#ifdef THREADS
+  void *bp;
+#endif
+
+  if (align == 0 || (align & (align - 1)) != 0)
+    return NULL;
+  if (align <= ALIGNMENT)
+    return mm_malloc(size);
+#ifdef THREADS
+  if (cache.epoch != heap_epoch)
+    cache_reset();
+  arena = cache.home;
+  LOCK();
+  remote_drain();
+  bp = heap_memalign(align, size);
+  UNLOCK();
+  return bp;
+#else
+  return heap_memalign(align, size);
+#endif
+}
+
+/*
+ * mm_aligned_alloc - The C11 aligned_alloc, which mm_memalign already is
+ */
+void *mm_aligned_alloc(size_t align, size_t size)
+{
+  return mm_memalign(align, size);
+}
+
+/*
+ * heap_memalign - Slab slots and mapped regions only have ALIGNMENT, so
+ *     any size gets a heap block, carved out of a free block by
+ *     alloc_aligned with its leading and trailing slack freed.
+ */
+static void *heap_memalign(size_t align, size_t size)
+{
+  if (size == 0 || align > MAXBLOCKSIZE / 2 ||
+      size > MAXBLOCKSIZE - DSIZE - align - MINBLOCKSIZE)
+    return NULL;
+  return alloc_aligned(MAX(ALIGN(size + WSIZE), MINBLOCKSIZE), align);
+}
+
+/*
+ * mm_malloc_batch - Allocates n blocks of size bytes each and stores
+ *     them in out. Returns how many were allocated, fewer than n only
+ *     when the heap cannot grow any more.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out)
+{
+#ifdef THREADS
+  int bin = cache_bin(size);
+  size_t done = 0;
+  void *bp;
+
+  if (cache.epoch != heap_epoch)
+    cache_reset();
+  while (bin > 0 && done < n && (bp = cache.bins[bin]) != NULL)
+  {
+    cache.bins[bin] = QUICK_NEXT(bp);
+    cache.count[bin]--;
+    cache.bytes -= bin * ALIGNMENT;
+    out[done++] = bp;
+  }
+  if (done == n)
+    return n;
+  arena = cache.home;
+  LOCK();
+  remote_drain();
+  done += heap_malloc_batch(size, n - done, out + done);
+  UNLOCK();
+  return done;
+#else
+  return heap_malloc_batch(size, n, out);
+#endif
+}
+
+/*
+ * mm_free_batch - Frees the n blocks of ptrs, which may hold NULLs, and
+ *     sorts ptrs by address on the way.
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+#ifdef THREADS
+  size_t i, j, k;
+  arena_t *a;
+
+  if (cache.epoch != heap_epoch)
+    cache_reset();
+  /* The blocks the thread cache keeps go there one by one */
+  for (i = 0; i < n; i++)
+  {
+    if (ptrs[i] != NULL && cache_size(ptrs[i]) != 0)
+    {
+      mm_free(ptrs[i]);
+      ptrs[i] = NULL;
+    }
+  }
+  sort_ptrs(ptrs, n);
+  /* The others go back in runs of one arena, under one lock per run */
+  for (i = 0; i < n; i = j)
+  {
+    if (ptrs[i] == NULL)
+    {
+      j = i + 1;
+      continue;
+    }
+    a = ARENA_OF(ptrs[i]);
+    for (j = i + 1; j < n && ARENA_OF(ptrs[j]) == a; j++)
+      ;
+    if (REMOTE_FREE && a != cache.home)
+    {
+      for (k = i; k < j; k++)
+        arena_free(ptrs[k]);
+      continue;
+    }
+    arena = a;
+    LOCK();
+    heap_free_batch(ptrs + i, j - i);
+    UNLOCK();
+  }
+#else
+  sort_ptrs(ptrs, n);
+  heap_free_batch(ptrs, n);
+#endif
+}
+
+/*
+ * heap_malloc_batch - Slab and mapped sizes are allocated one by one. Heap
+ *     blocks come from the quick list of their size first, then each free
+ *     block found is cut into as many blocks as it holds, and the wilderness,
+ *     grown once by the shortfall, takes the rest.
+ */
+static size_t heap_malloc_batch(size_t size, size_t n, void **out)
+{
+  size_t asize, avail, need, count, done = 0;
+  int class;
+  void *bp;
+
+  if (size == 0 || size > MAXBLOCKSIZE - DSIZE)
+    return 0;
+  if (size <= SLAB_MAX && slab_wanted(size, n))
+  {
+    for (class = slab_class(size); done < n && (out[done] = slab_alloc(class)) != NULL; done++)
+      ;
+    return done;
+  }
+  if (size >= MMAP_THRESHOLD)
+  {
+    while (done < n && (out[done] = map_alloc(size)) != NULL)
+      done++;
+    return done;
+  }
+  asize = MAX(ALIGN(size + WSIZE), MINBLOCKSIZE);
+  while (asize <= QUICK_MAX && done < n && (bp = arena->quick_lists[asize / ALIGNMENT]) != NULL)
+  {
+    arena->quick_lists[asize / ALIGNMENT] = QUICK_NEXT(bp);
+    arena->quick_bytes -= asize;
+    PUT(HDRP(bp), GET(HDRP(bp)) & ~GROWN);
+    out[done++] = bp;
+  }
+
+  arena->malloc_clock++;
+  while (done < n)
+  {
+    if ((bp = find_fit(asize)) == NULL && consolidate_before_grow(0))
+      bp = find_fit(asize);
+    if (bp == NULL)
+    {
+      avail = arena->wilderness != NULL ? GET_SIZE(HDRP(arena->wilderness)) : 0;
+      need = MIN(n - done, (MAXBLOCKSIZE - avail) / asize) * asize;
+      if (avail < need && extend_heap((need - avail) / WSIZE) == NULL && avail < asize)
+        break;
+      bp = arena->wilderness;
+    }
+    count = MIN(n - done, GET_SIZE(HDRP(bp)) / asize);
+    place_run(bp, asize, count, out + done);
+    done += count;
+  }
+  return done;
+}
+
+/*
+ * heap_free_batch - Frees the n blocks of ptrs, sorted by address. A run
+ *     of blocks lying side by side in the heap is freed as one block, so it
+ *     is coalesced and filed once.
+ */
+static void heap_free_batch(void **ptrs, size_t n)
+{
+  size_t i, size;
+  char *bp;
+
+  for (i = 0; i < n; i++)
+  {
+    if ((bp = ptrs[i]) == NULL)
+      continue;
+    if (IS_MAPPED(bp))
+      mem_unmap(MAP_START(bp));
+    else if (IS_SLAB(bp))
+      slab_free(bp);
+    else if (i + 1 == n || ptrs[i + 1] != NEXT_BLK(bp))
+      heap_free(bp);
+    else
+    {
+      size = GET_SIZE(HDRP(bp));
+      slab_count(size, -1);
+      while (i + 1 < n && ptrs[i + 1] == bp + size)
+      {
+        slab_count(GET_SIZE(HDRP(ptrs[++i])), -1);
+        size += GET_SIZE(HDRP(ptrs[i]));
+      }
+      PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+      PUT(FTRP(bp), PACK(size, 0));
+      coalesce(bp);
+      arena->dirty_bytes += size;
+    }
+  }
+  trim_heap();
+  if (PURGE_DUE())
+    purge_heap();
+}
+
+/* Sorts n pointers by address. A batch is usually short, or already in
+   order when it was allocated as one, which insertion sort goes through in
+   one pass without the calls qsort makes to compare. */
+static void sort_ptrs(void **ptrs, size_t n)
+{
+  size_t i, j;
+  void *p;
+
+  if (n > SORT_INSERT)
+  {
+    for (i = 1; i < n && (uintptr_t)ptrs[i - 1] <= (uintptr_t)ptrs[i]; i++)
+      ;
+    if (i < n)
+      qsort(ptrs, n, sizeof(void *), ptr_cmp);
+    return;
+  }
+  for (i = 1; i < n; i++)
+  {
+    p = ptrs[i];
+    for (j = i; j > 0 && (uintptr_t)ptrs[j - 1] > (uintptr_t)p; j--)
+      ptrs[j] = ptrs[j - 1];
+    ptrs[j] = p;
+  }
+}
+
+/* Orders pointers by address, for qsort */
+static int ptr_cmp(const void *a, const void *b)
+{
+  uintptr_t x = (uintptr_t)*(void *const *)a, y = (uintptr_t)*(void *const *)b;
+
+  return (x > y) - (x < y);
+}
+
+ /*  Finds fit for a block with "asize" bytes from the free lists.
+ *   The search starts at the size class of "asize": the first block
+ *   large enough in that class is taken, otherwise the head of the next
+ *   non-empty larger class (every block there is big enough).
+ *   Extends the heap if there is a remainder.
+ *   And Returns that block's address
+ *   or NULL if no suitable block was found. 
+ */
+static void *find_fit(size_t asize)
+{
+  void *bp;
+  int class;
+#ifdef TLSF
+  int fl, sl;
+  unsigned int map;
+
+  /* Round the request up to the next list boundary so that every block
+     of the list found is large enough, then look for a non-empty list at
+     or above it: first in the same range, then in the next ranges. */
+  class = size_class(search_size(asize));
+  fl = class / SL_COUNT;
+  sl = class % SL_COUNT;
+  map = arena->sl_bitmap[fl] & (~0U << sl);
+  if (map == 0)
+  {
+    map = (fl + 1 < FL_COUNT) ? arena->fl_bitmap & (~0U << (fl + 1)) : 0;
+    if (map == 0)
+      return NULL;
+    fl = __builtin_ffs(map) - 1;
+    map = arena->sl_bitmap[fl];
+  }
+  sl = __builtin_ffs(map) - 1;
+
+  /* Only the last list of the last range can hold blocks too small */
+  for (bp = arena->seg_lists[fl * SL_COUNT + sl]; bp != NULL; bp = GET_NEXT_PTR(bp))
+    if (asize <= (size_t)GET_SIZE(HDRP(bp)))
+      return bp;
+  return NULL;
+#else
+  int i;
+
+  if (asize < TREE_MIN)
+  {
+    for (class = size_class(asize); class < NUM_CLASSES; class++)
+    {
+      /* Look in the packed sizes first, then in the blocks the index
+         has no room for */
+      i = index_find(arena->index_size[class], arena->index_count[class], asize, 0);
+      arena->stats.index_scans += (i >= 0) ? i + 1 : arena->index_count[class];
+      if (i >= 0)
+        return FROM_OFF(arena->index_off[class][i]);
+      if (arena->list_count[class] == arena->index_count[class])
+        continue;
+      for (bp = arena->seg_lists[class]; bp != NULL; bp = GET_NEXT_PTR(bp))
+      {
+        arena->stats.fit_probes++;
+        if (asize <= (size_t)GET_SIZE(HDRP(bp)))
+          return bp;
+      }
+    }
+  }
+  /* Nothing in the lists: the smallest large block is the best fit */
+  return tree_best_fit(asize);
+#endif
+}
+
+/*   Place a block of "asize" bytes at the start of the free block "bp" and
+ *   split that block if the remainder would be at least the minimum block
+ *   size. 
+ */
+static void place(void *bp, size_t asize)
+{
+  size_t freeSize = GET_SIZE(HDRP(bp));
+  size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+  size_t page;
+
+  /* Remember which part of the block is still zero, for mm_calloc: the
+     wilderness past arena->fresh, or the pages a purge gave back. Either
+     way the links and stamp at the start and the footer are not. */
+  if (bp == arena->wilderness)
+  {
+    arena->zero_lo = MAX((char *)bp + 3 * LSIZE, arena->fresh);
+    arena->zero_hi = FTR_ADDR(bp);
+  }
+  else if (GET(HDRP(bp)) & DECOMMITTED)
+  {
+    page = mem_pagesize();
+    arena->zero_lo = (char *)ALIGN_UP((char *)bp + 3 * LSIZE, page);
+    arena->zero_hi = (char *)((uintptr_t)FTR_ADDR(bp) & ~(uintptr_t)(page - 1));
+  }
+  else
+    arena->zero_lo = arena->zero_hi = NULL;
+
+  /* Unlink while the header still holds the size the block was filed under */
+  delete_node(bp);
+  if ((freeSize - asize) >= MINBLOCKSIZE)
+  {
+    slab_count(asize, 1);
+    PUT(HDRP(bp), PACK(asize, prev_alloc | ALLOC));
+    bp = NEXT_BLK(bp);
+    PUT(HDRP(bp), PACK(freeSize - asize, PREV_ALLOC));
+    PUT(FTRP(bp), PACK(freeSize - asize, 0));
+    coalesce(bp);
+  }
+  else
+  {
+    slab_count(freeSize, 1);
+    PUT(HDRP(bp), PACK(freeSize, prev_alloc | ALLOC));
+    SET_PREV_ALLOC(HDRP(NEXT_BLK(bp)));
+    bp = NEXT_BLK(bp);
+  }
+  /* bp is now the block after the one placed */
+  arena->fresh = MAX(arena->fresh, (char *)bp);
+}
+
+/*   Places "count" blocks of "asize" bytes side by side at the start of
+ *   the free block bp, which holds them all, and stores them in out. They
+ *   are placed as one block, which is then cut by rewriting the headers;
+ *   the last one keeps any slack too small to split off.
+ */
+static void place_run(void *bp, size_t asize, size_t count, void **out)
+{
+  size_t i, size, flags;
+
+  place(bp, count * asize);
+  size = GET_SIZE(HDRP(bp));
+  flags = GET_FLAGS(HDRP(bp));
+  slab_count(size, -1);
+  for (i = 0; i < count; i++)
+  {
+    out[i] = bp;
+    PUT(HDRP(bp), PACK(i + 1 < count ? asize : size - i * asize, flags));
+    slab_count(GET_SIZE(HDRP(bp)), 1);
+    flags = PREV_ALLOC | ALLOC;
+    bp = (char *)bp + asize;
+  }
+}
+
+
+
+/*   Shrink the allocated block "bp" to "asize" bytes if the tail left over
+ *   would be at least the minimum block size, freeing that tail.
+ */
+static void trim_block(void *bp, size_t asize)
+{
+  size_t size = GET_SIZE(HDRP(bp));
+  void *tail;
+
+  if (size - asize < MINBLOCKSIZE)
+    return;
+  PUT(HDRP(bp), PACK(asize, GET_FLAGS(HDRP(bp))));
+  tail = NEXT_BLK(bp);
+  PUT(HDRP(tail), PACK(size - asize, PREV_ALLOC));
+  PUT(FTRP(tail), PACK(size - asize, 0));
+  coalesce(tail);
+  trim_heap();
+}
+
+#ifdef TLSF
+/* Index of the most significant set bit of size (size > 0) */
+static int fls_size(size_t size)
+{
+  return (int)(8 * sizeof(unsigned long)) - 1 - __builtin_clzl(size);
+}
+
+/* Maps a block size to the index fl * SL_COUNT + sl of its TLSF list */
+static int size_class(size_t size)
+{
+  int fl, sl;
+
+  if (size < SMALL_BLOCK)
+    return size / (SMALL_BLOCK / SL_COUNT);
+  fl = fls_size(size);
+  sl = (size >> (fl - SL_LOG2)) - SL_COUNT;
+  fl -= SMALL_LOG2 - 1;
+  if (fl >= FL_COUNT)
+    return NUM_CLASSES - 1;
+  return fl * SL_COUNT + sl;
+}
+
+/* Rounds size up to the smallest size of the next TLSF list */
+static size_t search_size(size_t size)
+{
+  if (size < SMALL_BLOCK)
+    return size + (SMALL_BLOCK / SL_COUNT) - 1;
+  return size + ((size_t)1 << (fls_size(size) - SL_LOG2)) - 1;
+}
+#else
+/* Maps a block size to the index of its segregated free list */
+static int size_class(size_t size)
+{
+  int class = 0;
+
+  size /= MINCLASSSIZE;
+  while (size > 1 && class < NUM_CLASSES - 1)
+  {
+    size >>= 1;
+    class++;
+  }
+  return class;
+}
+#endif
+
+/*Inserts and deletes the free block pointer int the free list of its class.
+ *The block header must hold its current size when either is called.*/
+
+static void insert_node(void *bp)
+{
+  int class = size_class(GET_SIZE(HDRP(bp)));
+  void *head = arena->seg_lists[class];
+
+  if (GET_SIZE(HDRP(NEXT_BLK(bp))) == 0)
+  {
+    arena->wilderness = bp;
+    return;
+  }
+
+  /* Old payload bytes must not pass for the stamp of the last purge_heap */
+  if (GET_SIZE(HDRP(bp)) >= DECOMMIT_MIN)
+    PURGE_STAMP(bp) = 0;
+
+#ifndef TLSF
+  if (GET_SIZE(HDRP(bp)) >= TREE_MIN)
+  {
+    tree_insert(bp);
+    return;
+  }
+#endif
+
+  SET_NEXT_PTR(bp, head);
+  SET_PREV_PTR(bp, NULL);
+  if (head != NULL)
+    SET_PREV_PTR(head, bp);
+  arena->seg_lists[class] = bp;
+#ifndef TLSF
+  arena->list_count[class]++;
+  if (arena->index_count[class] < INDEX_CAP)
+  {
+    arena->index_size[class][arena->index_count[class]] = GET_SIZE(HDRP(bp));
+    arena->index_off[class][arena->index_count[class]++] = TO_OFF(bp);
+  }
+#endif
+#ifdef TLSF
+  arena->sl_bitmap[class / SL_COUNT] |= 1U << (class % SL_COUNT);
+  arena->fl_bitmap |= 1U << (class / SL_COUNT);
+#endif
+}
+
+static void delete_node(void *bp)
+{
+  int class = size_class(GET_SIZE(HDRP(bp)));
+#ifndef TLSF
+  int i, n;
+#endif
+
+  if (bp == arena->wilderness)
+  {
+    arena->wilderness = NULL;
+    return;
+  }
+#ifndef TLSF
+  if (GET_SIZE(HDRP(bp)) >= TREE_MIN)
+  {
+    tree_remove(bp);
+    return;
+  }
+#endif
+
+  if (GET_PREV_PTR(bp))
+    SET_NEXT_PTR(GET_PREV_PTR(bp), GET_NEXT_PTR(bp));
+  else
+    arena->seg_lists[class] = GET_NEXT_PTR(bp);
+  if (GET_NEXT_PTR(bp))
+    SET_PREV_PTR(GET_NEXT_PTR(bp), GET_PREV_PTR(bp));
+#ifndef TLSF
+  arena->list_count[class]--;
+  /* Fill the hole in the index with its last entry */
+  if ((i = index_find(arena->index_off[class], arena->index_count[class], TO_OFF(bp), 1)) >= 0)
+  {
+    n = --arena->index_count[class];
+    arena->index_size[class][i] = arena->index_size[class][n];
+    arena->index_off[class][i] = arena->index_off[class][n];
+  }
+#endif
+#ifdef TLSF
+  if (arena->seg_lists[class] == NULL)
+  {
+    arena->sl_bitmap[class / SL_COUNT] &= ~(1U << (class % SL_COUNT));
+    if (arena->sl_bitmap[class / SL_COUNT] == 0)
+      arena->fl_bitmap &= ~(1U << (class / SL_COUNT));
+  }
+#endif
+}
+
+#ifndef TLSF
+/* Returns the position of the first of the n values of v that is at least
+ * key (or equal to key if exact is set), or -1 if there is none.
+ * Sizes and offsets are unsigned, so they are biased by 2^31 before the
+ * signed SIMD compares.
+ */
+static int index_find(const uint32_t *v, int n, uint32_t key, int exact)
+{
+  int i = 0;
+  int mask;
+#if defined(__AVX2__)
+  __m256i bias = _mm256_set1_epi32(INT32_MIN);
+  __m256i k = _mm256_set1_epi32(exact ? (int)key : (int)((key - 1) ^ INT32_MIN));
+  __m256i x, c;
+
+  for (; i + 8 <= n; i += 8)
+  {
+    x = _mm256_loadu_si256((const __m256i *)(v + i));
+    c = exact ? _mm256_cmpeq_epi32(x, k)
+              : _mm256_cmpgt_epi32(_mm256_xor_si256(x, bias), k);
+    if ((mask = _mm256_movemask_ps(_mm256_castsi256_ps(c))) != 0)
+      return i + __builtin_ctz(mask);
+  }
+#elif defined(__SSE2__)
+  __m128i bias = _mm_set1_epi32(INT32_MIN);
+  __m128i k = _mm_set1_epi32(exact ? (int)key : (int)((key - 1) ^ INT32_MIN));
+  __m128i x, c;
+
+  for (; i + 4 <= n; i += 4)
+  {
+    x = _mm_loadu_si128((const __m128i *)(v + i));
+    c = exact ? _mm_cmpeq_epi32(x, k)
+              : _mm_cmpgt_epi32(_mm_xor_si128(x, bias), k);
+    if ((mask = _mm_movemask_ps(_mm_castsi128_ps(c))) != 0)
+      return i + __builtin_ctz(mask);
+  }
+#endif
+  for (; i < n; i++)
+    if (exact ? v[i] == key : v[i] >= key)
+      return i;
+  (void)mask;
+  return -1;
+}
+
+/* Orders the key (size, addr) against the tree block bp */
+static int tree_cmp(size_t size, void *addr, void *bp)
+{
+  size_t bsize = GET_SIZE(HDRP(bp));
+
+  if (size != bsize)
+    return size < bsize ? -1 : 1;
+  if (addr != bp)
+    return (char *)addr < (char *)bp ? -1 : 1;
+  return 0;
+}
+
+/* Top-down splay of the tree t around the key (size, addr).
+ * The returned root is the block with that key if there is one,
+ * otherwise the last block met on the search path (a neighbour of the key).
+ * Links are heap offsets, so the left and right trees are assembled from
+ * their roots and extreme nodes instead of a header node on the stack.
+ */
+static void *splay(void *t, size_t size, void *addr)
+{
+  void *lroot = NULL, *rroot = NULL; /* Keys smaller / larger than the key */
+  void *l = NULL, *r = NULL;         /* Maximum of lroot / minimum of rroot */
+  void *y;
+
+  if (t == NULL)
+    return NULL;
+  for (;;)
+  {
+    if (tree_cmp(size, addr, t) < 0)
+    {
+      if (GET_LEFT(t) == NULL)
+        break;
+      if (tree_cmp(size, addr, GET_LEFT(t)) < 0)
+      { /* rotate right */
+        y = GET_LEFT(t);
+        SET_LEFT(t, GET_RIGHT(y));
+        SET_RIGHT(y, t);
+        t = y;
+        if (GET_LEFT(t) == NULL)
+          break;
+      }
+      /* link right */
+      if (r == NULL)
+        rroot = t;
+      else
+        SET_LEFT(r, t);
+      r = t;
+      t = GET_LEFT(t);
+    }
+    else if (tree_cmp(size, addr, t) > 0)
+    {
+      if (GET_RIGHT(t) == NULL)
+        break;
+      if (tree_cmp(size, addr, GET_RIGHT(t)) > 0)
+      { /* rotate left */
+        y = GET_RIGHT(t);
+        SET_RIGHT(t, GET_LEFT(y));
+        SET_LEFT(y, t);
+        t = y;
+        if (GET_RIGHT(t) == NULL)
+          break;
+      }
+      /* link left */
+      if (l == NULL)
+        lroot = t;
+      else
+        SET_RIGHT(l, t);
+      l = t;
+      t = GET_RIGHT(t);
+    }
+    else
+      break;
+  }
+  /* reassemble */
+  if (l != NULL)
+  {
+    SET_RIGHT(l, GET_LEFT(t));
+    SET_LEFT(t, lroot);
+  }
+  if (r != NULL)
+  {
+    SET_LEFT(r, GET_RIGHT(t));
+    SET_RIGHT(t, rroot);
+  }
+  return t;
+}
+
+static void tree_insert(void *bp)
+{
+  void *t = splay(arena->tree_root, GET_SIZE(HDRP(bp)), bp);
+
+  if (t == NULL)
+  {
+    SET_LEFT(bp, NULL);
+    SET_RIGHT(bp, NULL);
+  }
+  else if (tree_cmp(GET_SIZE(HDRP(bp)), bp, t) < 0)
+  {
+    SET_LEFT(bp, GET_LEFT(t));
+    SET_RIGHT(bp, t);
+    SET_LEFT(t, NULL);
+  }
+  else
+  {
+    SET_RIGHT(bp, GET_RIGHT(t));
+    SET_LEFT(bp, t);
+    SET_RIGHT(t, NULL);
+  }
+  arena->tree_root = bp;
+}
+
+static void tree_remove(void *bp)
+{
+  void *t = splay(arena->tree_root, GET_SIZE(HDRP(bp)), bp);
+
+  if (GET_LEFT(t) == NULL)
+    arena->tree_root = GET_RIGHT(t);
+  else
+  {
+    /* bp is larger than its whole left subtree: splaying the subtree around
+       it brings up the maximum, which has no right child */
+    arena->tree_root = splay(GET_LEFT(t), GET_SIZE(HDRP(bp)), bp);
+    SET_RIGHT(arena->tree_root, GET_RIGHT(t));
+  }
+}
+
+/* Returns the smallest (lowest addressed on ties) block of at least asize
+   bytes, or NULL. The block stays in the tree. */
+static void *tree_best_fit(size_t asize)
+{
+  void *bp;
+
+  if (arena->tree_root == NULL)
+    return NULL;
+  arena->tree_root = splay(arena->tree_root, asize, NULL);
+  if (GET_SIZE(HDRP(arena->tree_root)) >= asize)
+    return arena->tree_root;
+  /* The root is the predecessor of asize, take its successor */
+  for (bp = GET_RIGHT(arena->tree_root); bp != NULL && GET_LEFT(bp) != NULL; bp = GET_LEFT(bp))
+    ;
+  return bp;
+}
+
+/* Checks the order of the subtree t, returns its number of blocks or -1 */
+static int tree_check(void *t, void *lo, void *hi)
+{
+  int left, right;
+
+  if (t == NULL)
+    return 0;
+  if (GET_ALLOC(HDRP(t)) || GET_SIZE(HDRP(t)) < TREE_MIN ||
+      (lo != NULL && tree_cmp(GET_SIZE(HDRP(lo)), lo, t) >= 0) ||
+      (hi != NULL && tree_cmp(GET_SIZE(HDRP(hi)), hi, t) <= 0))
+  {
+    printf("Bad block %p in the tree\n", t);
+    return -1;
+  }
+  if ((left = tree_check(GET_LEFT(t), lo, t)) < 0 ||
+      (right = tree_check(GET_RIGHT(t), t, hi)) < 0)
+    return -1;
+  return left + right + 1;
+}
+#endif
+
+/*   Allocate a block of "asize" bytes whose payload address is a multiple
+ *   of "align" (a power of two). A free block with room for the worst case
+ *   leading slack is taken from the free lists, otherwise the heap is
+ *   extended by just what an aligned payload at its top needs. The slack in
+ *   front of the aligned payload is returned to the free lists.
+ */
+static void *alloc_aligned(size_t asize, size_t align)
+{
+  size_t need = asize + align + MINBLOCKSIZE;
+  size_t bsize, lead;
+  char *top, *bp0;
+  void *bp, *abp;
+
+  if ((bp = find_fit(need)) == NULL && consolidate_before_grow(need))
+    bp = find_fit(need);
+  if (bp == NULL)
+  {
+    /* The block at the top starts at the trailing free block, if any */
+    top = (char *)mem_arena_hi(arena->id) + 1;
+    bp0 = GET_PREV_ALLOC(HDRP(top)) ? top : PREV_BLK(top);
+    abp = (void *)ALIGN_UP(bp0, align);
+    if (abp != bp0 && (char *)abp - bp0 < MINBLOCKSIZE)
+      abp = (char *)abp + align;
+    if ((char *)abp + asize <= top)
+      bp = bp0;
+    else if ((bp = extend_heap(((char *)abp + asize - top) / WSIZE)) == NULL)
+      return NULL;
+  }
+
+  abp = bp;
+  if ((uintptr_t)bp % align != 0)
+  {
+    /* The leading slack must be big enough to stand as a free block */
+    abp = (void *)ALIGN_UP((char *)bp + MINBLOCKSIZE, align);
+    lead = (char *)abp - (char *)bp;
+    bsize = GET_SIZE(HDRP(bp));
+    delete_node(bp);
+    PUT(HDRP(bp), PACK(lead, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(lead, 0));
+    PUT(HDRP(abp), PACK(bsize - lead, 0));
+    PUT(FTRP(abp), PACK(bsize - lead, 0));
+    insert_node(bp);
+    insert_node(abp);
+  }
+  place(abp, asize);
+  return abp;
+}
+
+/*   Allocates a block of "asize" bytes at the end of the heap, starting
+ *   at the trailing free block if there is one.
+ */
+static void *alloc_top(size_t asize)
+{
+  char *top = (char *)mem_arena_hi(arena->id) + 1;
+  size_t avail = 0;
+  void *bp;
+
+  if (!GET_PREV_ALLOC(HDRP(top)))
+    avail = GET_SIZE(PREV_FTRP(top));
+  if (avail < asize && consolidate_before_grow(asize - avail))
+  {
+    /* The trailing free block may have grown, or been trimmed */
+    top = (char *)mem_arena_hi(arena->id) + 1;
+    avail = GET_PREV_ALLOC(HDRP(top)) ? 0 : GET_SIZE(PREV_FTRP(top));
+  }
+  if (avail < asize)
+  {
+    if ((bp = extend_heap((asize - avail) / WSIZE)) == NULL)
+      return NULL;
+  }
+  else
+    bp = top - avail;
+  place(bp, asize);
+  return bp;
+}
+
+/*   Empties the quick lists, freeing and coalescing each of their blocks.
+ */
+static void consolidate(void)
+{
+  int i;
+  void *bp;
+  size_t size;
+
+  for (i = 0; i < QUICK_LISTS; i++)
+  {
+    while ((bp = arena->quick_lists[i]) != NULL)
+    {
+      arena->quick_lists[i] = QUICK_NEXT(bp);
+      size = GET_SIZE(HDRP(bp));
+      slab_count(size, -1);
+      PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+      PUT(FTRP(bp), PACK(size, 0));
+      coalesce(bp);
+    }
+  }
+  arena->quick_bytes = 0;
+  trim_heap();
+}
+
+/*   Consolidates the quick lists before the heap grows by "shortfall"
+ *   bytes, if they hold at least 1/QUICK_SHORTFALL of it: merged, they may
+ *   make the growth smaller or unneeded. In a THREADS build the blocks the
+ *   thread cache holds in this arena are freed first. Returns 1 if any
+ *   block was freed, so the caller must look at the heap again.
+ */
+static int consolidate_before_grow(size_t shortfall)
+{
+  int freed = 0;
+
+#ifdef THREADS
+  freed = cache_release();
+#endif
+  if (arena->quick_bytes == 0 || arena->quick_bytes < shortfall / QUICK_SHORTFALL)
+    return freed;
+  consolidate();
+  return 1;
+}
+
+/*   Releases the physical pages lying strictly inside the free blocks of
+ *   at least DECOMMIT_MIN bytes, but the wilderness, that were already free
+ *   at the previous pass: blocks reused quickly are not decommitted only to
+ *   fault their pages back in. A block is stamped with the pass number
+ *   right after its links, a stamp insert_node clears when the block is
+ *   freed. The pages holding the boundary tags, links and
+ *   stamp are kept; the others come back zeroed when they are reused.
+ */
+static void purge_heap(void)
+{
+  size_t page = mem_pagesize();
+  uintptr_t lo, hi;
+  void *bp;
+
+  arena->purge_epoch++;
+  for (bp = NEXT_BLK(arena->heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLK(bp))
+  {
+    if (GET(HDRP(bp)) & (ALLOC | DECOMMITTED) || bp == arena->wilderness ||
+        GET_SIZE(HDRP(bp)) < DECOMMIT_MIN)
+      continue;
+    if (PURGE_STAMP(bp) != arena->purge_epoch - 1)
+    {
+      PURGE_STAMP(bp) = arena->purge_epoch;
+      continue;
+    }
+    lo = ALIGN_UP((char *)bp + 3 * LSIZE, page);
+    hi = (uintptr_t)FTR_ADDR(bp) & ~(uintptr_t)(page - 1);
+    if (hi > lo)
+      mem_decommit((void *)lo, hi - lo);
+    PUT(HDRP(bp), GET(HDRP(bp)) | DECOMMITTED);
+  }
+  arena->dirty_bytes = 0;
+}
+
+/*   Gives the wilderness back to memlib once it reaches TRIM_THRESHOLD
+ *   bytes, its header becoming the new epilogue.
+ */
+static void trim_heap(void)
+{
+  size_t size;
+
+  if (arena->wilderness == NULL || (size = GET_SIZE(HDRP(arena->wilderness))) < TRIM_THRESHOLD)
+    return;
+  if (mem_arena_trim(arena->id, size) == (void *)-1)
+    return;
+  arena->wilderness = NULL;
+  PUT(HDRP((char *)mem_arena_hi(arena->id) + 1), PACK(0, ALLOC | PREV_ALLOC));
+}
+
+/*   Serves a huge request from a region mapped apart from the heap,
+ *   which mm_free unmaps and mm_realloc remaps.
+ */
+static void *map_alloc(size_t size)
+{
+  size_t len = PAGE_ROUND(size + MAP_OFFSET);
+  char *lo;
+
+  if ((lo = mem_map(len)) == NULL)
+    return NULL;
+  MAP_LEN(lo + MAP_OFFSET) = len;
+  return lo + MAP_OFFSET;
+}
+
+/* Maps a request of at most SLAB_MAX bytes to its slab class */
+static int slab_class(size_t size)
+{
+  return slab_classes[(size + 7) / 8];
+}
+
+/* Returns 1 if requests of size bytes are served from slabs. Their class
+   gets slabs once the heap blocks in use that such requests take, and the
+   n about to be taken, would fill a slab. Slabs still cost amptjp, cccp
+   and cp-decl a few points of utilization, so they are off by default. */
+static int slab_wanted(size_t size, size_t n)
+{
+  int class = slab_class(size);
+
+  if (!SLABS)
+    return 0;
+  if (arena->slab_on & (1 << class))
+    return 1;
+  if (arena->slab_demand[DEMAND_CLASS(MAX(ALIGN(size + WSIZE), MINBLOCKSIZE))] + n <
+      SLAB_SLOTS(class))
+    return 0;
+  arena->slab_on |= 1 << class;
+  return 1;
+}
+
+/* Adds delta to the count of heap blocks marked allocated of the slab
+   class of a block of bsize bytes, as the block is handed out (1), freed
+   (-1) or resized. Every path that does either goes through here with the
+   size in the header, so the count matches the blocks in the heap. A block
+   in a quick list still counts until consolidate frees it. */
+static void slab_count(size_t bsize, int delta)
+{
+  if (bsize <= SLAB_MAX + DSIZE)
+    arena->slab_demand[DEMAND_CLASS(bsize)] += delta;
+}
+
+/* Returns the slab holding p, or NULL if p is not in a slab. The slab
+   starts in the page of p or in the page before. */
+static inline slab_t *slab_of(void *p)
+{
+  size_t i = SLAB_INDEX(p);
+  char *page = PAGE_OF(p);
+  unsigned start;
+
+  if ((start = __atomic_load_n(&slab_map[i], __ATOMIC_RELAXED)) != 0 &&
+      page + (start - 1) * ALIGNMENT <= (char *)p)
+    return (slab_t *)(page + (start - 1) * ALIGNMENT);
+  if (i > 0 && (start = __atomic_load_n(&slab_map[i - 1], __ATOMIC_RELAXED)) != 0 &&
+      page + (start - 1) * ALIGNMENT > (char *)p)
+    return (slab_t *)(page - SLAB_SIZE + (start - 1) * ALIGNMENT);
+  return NULL;
+}
+
+/* Takes a free slot of the given class, making a new slab if none is left */
+static void *slab_alloc(int class)
+{
+  slab_t *slab = arena->slab_lists[class];
+  int i, word, slot;
+
+  if (slab == NULL)
+  {
+    /* Take a block of one page from the heap and mark all slots free.
+       The slots a THREADS build frees meanwhile may refill the list. */
+    if ((slab = heap_alloc(SLAB_SIZE - WSIZE)) == NULL)
+      return NULL;
+    slab->next = arena->slab_lists[class];
+    slab->prev = NULL;
+    if (slab->next != NULL)
+      slab->next->prev = slab;
+    slab->class = class;
+    slab->nfree = SLAB_SLOTS(class);
+    memset(slab->bitmap, 0, sizeof(slab->bitmap));
+    for (i = 0; i < (int)slab->nfree; i++)
+      slab->bitmap[i / 64] |= (uint64_t)1 << (i % 64);
+    __atomic_store_n(&slab_map[SLAB_INDEX(slab)],
+                     ((char *)slab - PAGE_OF(slab)) / ALIGNMENT + 1, __ATOMIC_RELAXED);
+    arena->slab_map_len = MAX(arena->slab_map_len, SLAB_INDEX(slab) + 1);
+    arena->slab_lists[class] = slab;
+  }
+
+  /* The lowest set bit of the first non-empty word is a free slot */
+  for (word = 0; slab->bitmap[word] == 0; word++)
+    ;
+  slot = word * 64 + __builtin_ctzll(slab->bitmap[word]);
+  slab->bitmap[word] &= slab->bitmap[word] - 1;
+
+  /* A full slab leaves the list of its class */
+  if (--slab->nfree == 0)
+  {
+    arena->slab_lists[class] = slab->next;
+    if (slab->next != NULL)
+      slab->next->prev = NULL;
+  }
+  return (char *)slab + SLAB_FIRST + slot * slab_sizes[class];
+}
+
+/* Returns a slot to its slab. An empty slab goes back to the heap unless
+   it is the only one of its class with free slots. */
+static void slab_free(void *bp)
+{
+  slab_t *slab = SLAB_OF(bp);
+  int class = slab->class;
+  int slot = ((char *)bp - (char *)slab - SLAB_FIRST) / slab_sizes[class];
+
+  slab->bitmap[slot / 64] |= (uint64_t)1 << (slot % 64);
+  if (slab->nfree++ == 0)
+  {
+    /* It was full, put it back in the list */
+    slab->prev = NULL;
+    slab->next = arena->slab_lists[class];
+    if (slab->next != NULL)
+      slab->next->prev = slab;
+    arena->slab_lists[class] = slab;
+  }
+  else if (slab->nfree == SLAB_SLOTS(class) &&
+           (slab->prev != NULL || slab->next != NULL))
+  {
+    if (slab->prev != NULL)
+      slab->prev->next = slab->next;
+    else
+      arena->slab_lists[class] = slab->next;
+    if (slab->next != NULL)
+      slab->next->prev = slab->prev;
+    __atomic_store_n(&slab_map[SLAB_INDEX(slab)], 0, __ATOMIC_RELAXED);
+    heap_free(slab);
+  }
+}
+
+#ifdef THREADS
+/* Empties the cache of the calling thread, whose blocks belong to older
+   heaps, gives the thread the next arena in turn and has the cache flushed
+   when the thread exits */
+static void cache_reset(void)
+{
+  memset(&cache, 0, sizeof(cache));
+  cache.epoch = heap_epoch;
+  cache.home = &arenas[__atomic_fetch_add(&arena_next, 1, __ATOMIC_RELAXED) % arena_count];
+  pthread_setspecific(cache_key, &cache);
+}
+
+/* Returns the size of the cache bin mm_free keeps bp in, or 0 if it is not
+   kept. Other threads may flip the PREV_ALLOC bit of the header meanwhile,
+   but not the size of an allocated block. A heap block shrunk to at most
+   SLAB_MAX bytes has less room than the slots of its bin and is not kept. */
+static size_t cache_size(void *bp)
+{
+  size_t size;
+
+  if (IS_MAPPED(bp))
+    return 0;
+  if (IS_SLAB(bp))
+    size = slab_sizes[SLAB_OF(bp)->class];
+  else if ((size = GET_SIZE(HDRP(bp))) <= SLAB_MAX)
+    return 0;
+  return size <= CACHE_MAX ? size : 0;
+}
+
+/* Keeps bp in the cache bin of blocks of size bytes, or gives it back to
+   its arena if size is 0. Beyond CACHE_BYTES, half of the blocks of each
+   bin are flushed and the demand of each bin is halved. */
+static void cache_put(void *bp, size_t size)
+{
+  int bin = size / ALIGNMENT;
+
+  if (size == 0)
+  {
+    arena_free(bp);
+    return;
+  }
+  QUICK_NEXT(bp) = cache.bins[bin];
+  cache.bins[bin] = bp;
+  cache.count[bin]++;
+  if ((cache.bytes += size) <= CACHE_BYTES)
+    return;
+  for (bin = 1; bin < CACHE_BINS; bin++)
+  {
+    cache_flush(bin, cache.count[bin] / 2);
+    cache.demand[bin] /= 2;
+  }
+}
+
+/* Maps a request to its cache bin, or to 0 if it is not cached */
+static int cache_bin(size_t size)
+{
+  if (size == 0)
+    return 0;
+  if (size <= SLAB_MAX)
+    return slab_sizes[slab_class(size)] / ALIGNMENT;
+  if (size <= CACHE_MAX - WSIZE)
+    return MAX(ALIGN(size + WSIZE), MINBLOCKSIZE) / ALIGNMENT;
+  return 0;
+}
+
+/* Allocates a block for the request. A bin missed CACHE_DEMAND times or
+   more is also filled with one block per miss, up to CACHE_FILL bytes,
+   taken from room the heap already has. The lock of the home arena is
+   held. */
+static void *cache_fill(int bin, size_t size)
+{
+  int n;
+  void *bp, *next;
+
+  if ((bp = heap_alloc(size)) == NULL)
+    return NULL;
+  /* The heap blocks of a class without slabs yet do not fit its bin */
+  if (size <= SLAB_MAX && !IS_SLAB(bp))
+    return bp;
+  if (cache.demand[bin] < UCHAR_MAX)
+    cache.demand[bin]++;
+  if (cache.demand[bin] < CACHE_DEMAND)
+    return bp;
+  n = MIN(cache.demand[bin], CACHE_FILL / (bin * ALIGNMENT));
+  cache.filling = 1;
+  while (cache.count[bin] < n && cache.bytes + bin * ALIGNMENT <= CACHE_BYTES &&
+         (next = heap_alloc(size)) != NULL)
+  {
+    QUICK_NEXT(next) = cache.bins[bin];
+    cache.bins[bin] = next;
+    cache.count[bin]++;
+    cache.bytes += bin * ALIGNMENT;
+  }
+  cache.filling = 0;
+  return bp;
+}
+
+/* Gives back the blocks of a bin but the first keep ones, each to the
+   arena it came from */
+static void cache_flush(int bin, int keep)
+{
+  void **link = &cache.bins[bin];
+  void *bp;
+
+  while (keep-- > 0 && *link != NULL)
+    link = &QUICK_NEXT(*link);
+  while ((bp = *link) != NULL)
+  {
+    *link = QUICK_NEXT(bp);
+    cache.count[bin]--;
+    cache.bytes -= bin * ALIGNMENT;
+    arena_free(bp);
+  }
+}
+
+/* Frees the blocks of the cache that lie in the arena, whose lock is held,
+   so that they merge with their neighbours before its heap grows. Returns
+   the number of blocks freed; none are while a refill runs. */
+static int cache_release(void)
+{
+  int bin, freed = 0;
+  void **link, *bp;
+
+  if (cache.epoch != heap_epoch || cache.filling)
+    return 0;
+  for (bin = 1; bin < CACHE_BINS; bin++)
+  {
+    link = &cache.bins[bin];
+    while ((bp = *link) != NULL)
+    {
+      if (ARENA_OF(bp) != arena)
+      {
+        link = &QUICK_NEXT(bp);
+        continue;
+      }
+      *link = QUICK_NEXT(bp);
+      cache.count[bin]--;
+      cache.bytes -= bin * ALIGNMENT;
+      heap_free(bp);
+      freed++;
+    }
+  }
+  return freed;
+}
+
+/* Frees a block into the arena its address lies in. A block of another
+   arena than the home one of the thread is pushed on the remote stack of
+   its arena with a single compare-and-swap, instead of taking the lock
+   its owner keeps taking. */
+static void arena_free(void *bp)
+{
+  arena_t *a = ARENA_OF(bp);
+  void *head;
+
+  if (REMOTE_FREE && a != cache.home)
+  {
+    head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+    do
+      QUICK_NEXT(bp) = head;
+    while (!__atomic_compare_exchange_n(&a->remote, &head, bp, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return;
+  }
+  arena = a;
+  LOCK();
+  heap_free(bp);
+  UNLOCK();
+}
+
+/* Frees all the blocks on the remote stack of the arena, taken at once so
+   that pushes may go on meanwhile. The lock of the arena is held. */
+static void remote_drain(void)
+{
+  void *bp, *next;
+
+  if (__atomic_load_n(&arena->remote, __ATOMIC_RELAXED) == NULL)
+    return;
+  bp = __atomic_exchange_n(&arena->remote, NULL, __ATOMIC_ACQUIRE);
+  for (; bp != NULL; bp = next)
+  {
+    next = QUICK_NEXT(bp);
+    heap_free(bp);
+  }
+}
+
+/* Destructor of cache_key: an exiting thread flushes its whole cache */
+static void cache_exit(void *arg)
+{
+  int bin;
+
+  (void)arg;
+  if (cache.epoch == heap_epoch)
+    for (bin = 0; bin < CACHE_BINS; bin++)
+      cache_flush(bin, 0);
+  cache.epoch = 0;
+}
+#endif
+
+/* Adds up the counters the arenas gathered since mm_init */
+void mm_get_stats(mm_stats_t *st)
+{
+  arena_t *a;
+
+  memset(st, 0, sizeof(*st));
+  for (a = arenas; a < arenas + arena_count; a++)
+  {
+#ifdef THREADS
+    pthread_mutex_lock(&a->lock);
+#endif
+    st->fit_probes += a->stats.fit_probes;
+    st->index_scans += a->stats.index_scans;
+    st->realloc_inplace += a->stats.realloc_inplace;
+    st->realloc_moves += a->stats.realloc_moves;
+    st->copy_bytes += a->stats.copy_bytes;
+#ifdef THREADS
+    pthread_mutex_unlock(&a->lock);
+#endif
+  }
+}
+
+/* Heap consistency checker, returns 0 if the heap is consistent */
+static int mm_check(void)
+{
+  void *bp;
+  int class;
+#ifndef TLSF
+  int i;
+#endif
+  int listed = 0;
+  int free_blocks = 0;
+  size_t demand[SLAB_CLASSES] = {0};
+
+  // Only free blocks of the right class inside each free list
+  for (class = 0; class < NUM_CLASSES; class++)
+  {
+    for (bp = arena->seg_lists[class]; bp != NULL; bp = GET_NEXT_PTR(bp))
+    {
+      if (GET_ALLOC(HDRP(bp)) || size_class(GET_SIZE(HDRP(bp))) != class)
+      {
+        printf("Bad block %p in free list %d\n", bp, class);
+        return 1;
+      }
+      if (GET_NEXT_PTR(bp) != NULL && GET_PREV_PTR(GET_NEXT_PTR(bp)) != bp)
+      {
+        printf("Broken link after %p in free list %d\n", bp, class);
+        return 1;
+      }
+      listed++;
+    }
+#ifndef TLSF
+    for (i = 0; i < arena->index_count[class]; i++)
+    {
+      bp = FROM_OFF(arena->index_off[class][i]);
+      if (GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) != arena->index_size[class][i] ||
+          size_class(arena->index_size[class][i]) != class)
+      {
+        printf("Stale index entry %d of class %d\n", i, class);
+        return 1;
+      }
+    }
+#endif
+  }
+#ifndef TLSF
+  if ((class = tree_check(arena->tree_root, NULL, NULL)) < 0)
+    return 1;
+  listed += class;
+#endif
+  if (arena->wilderness != NULL)
+  {
+    if (GET_ALLOC(HDRP(arena->wilderness)) || GET_SIZE(HDRP(NEXT_BLK(arena->wilderness))) != 0)
+    {
+      printf("Wilderness %p is not the last free block\n", arena->wilderness);
+      return 1;
+    }
+    listed++;
+  }
+
+  //Check Coalesce and count the free blocks of the heap
+  for (bp = NEXT_BLK(arena->heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLK(bp))
+  {
+    if (!GET_PREV_ALLOC(HDRP(NEXT_BLK(bp))) != !GET_ALLOC(HDRP(bp)))
+    {
+      printf("Previous-allocated bit after %p is wrong\n", bp);
+      return 1;
+    }
+    if (!GET_ALLOC(HDRP(bp)))
+    {
+      if (GET_SIZE(HDRP(bp)) != GET_SIZE(FTRP(bp)))
+      {
+        printf("Header and footer of %p differ\n", bp);
+        return 1;
+      }
+      free_blocks++;
+      if (!GET_ALLOC(HDRP(NEXT_BLK(bp))))
+      {
+        printf("Uncoalesced free blocks at %p\n", bp);
+        return 1;
+      }
+    }
+    else if (GET_SIZE(HDRP(bp)) <= SLAB_MAX + DSIZE)
+      demand[DEMAND_CLASS(GET_SIZE(HDRP(bp)))]++;
+  }
+  printf("End of heap : %p \n", bp);
+
+  for (class = 0; class < SLAB_CLASSES; class++)
+    if (demand[class] != arena->slab_demand[class])
+    {
+      printf("Slab class %d has %lu heap blocks in use, counted %lu\n", class,
+             (unsigned long)demand[class], (unsigned long)arena->slab_demand[class]);
+      return 1;
+    }
+
+  //is every free block in the free lists
+  if (free_blocks != listed)
+  {
+    printf("%d free blocks but %d in the free lists\n", free_blocks, listed);
+    return 1;
+  }
+  return 0;
 }
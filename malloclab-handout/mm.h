@@ -3,7 +3,49 @@
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
+extern void mm_free_sized(void *ptr, size_t size);
+extern size_t mm_usable_size(void *ptr);
+extern void *mm_malloc_at_least(size_t size, size_t *usable);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern void *mm_aligned_alloc(size_t align, size_t size);
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+extern void mm_free_batch(void **ptrs, size_t n);
+extern void mm_set_arenas(int n);
+
+/*
+ * Regions hand out memory that is freed all at once
+ */
+typedef struct mm_region mm_region_t;
+
+extern mm_region_t *mm_region_create(size_t chunk_size);
+extern void *mm_region_alloc(mm_region_t *r, size_t size);
+extern void mm_region_reset(mm_region_t *r);
+extern void mm_region_destroy(mm_region_t *r);
+
+/*
+ * Pools hand out objects of one size
+ */
+typedef struct mm_pool mm_pool_t;
+
+extern mm_pool_t *mm_pool_create(size_t size, size_t align);
+extern void *mm_pool_alloc(mm_pool_t *pool);
+extern void mm_pool_free(mm_pool_t *pool, void *ptr);
+extern void mm_pool_destroy(mm_pool_t *pool);
+
+/*
+ * Counters kept by the allocator since the last mm_init, for the driver
+ */
+typedef struct {
+    unsigned long fit_probes;  /* free blocks whose header find_fit read */
+    unsigned long index_scans; /* packed index entries find_fit compared */
+    unsigned long realloc_inplace; /* mm_realloc calls that kept the block */
+    unsigned long realloc_moves;   /* mm_realloc calls that moved the block */
+    unsigned long copy_bytes;      /* bytes copied by those moves */
+} mm_stats_t;
+
+extern void mm_get_stats(mm_stats_t *stats);
 
 
 /* 